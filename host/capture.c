@@ -0,0 +1,271 @@
+// Capture pipeline.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "capture.h"
+#include "source.h"
+#include "ring.h"
+#include "trace.h"
+#include "sctfile.h"
+#include "ps2.h"
+
+// Chunk buffers in flight between decoder and writer.
+#define CAPTURE_CHUNKS	64
+// How often idle threads look at their ring again.
+#define CAPTURE_POLL_US	1000
+
+static volatile sig_atomic_t stop;
+
+void capture_stop(void)
+{
+	stop = 1;
+}
+
+typedef struct pipeline {
+	source src;
+	ring raw;				// reader -> decoder, bytes
+	ring full;				// decoder -> writer, sct_encoder*
+	ring empty;				// writer -> decoder, sct_encoder*
+	sct_encoder chunks[CAPTURE_CHUNKS];
+	sct_encoder* cur;		// being filled by the decoder
+	uint64_t t_last;		// of the last event encoded, in any chunk
+	trace_parser parser;
+	uint32_t tick_hz;
+	char ps2_path[4096];
+	FILE* ps2;				// made at the first device decoded byte
+	int ps2_errno;
+	int reader_done;
+	int decoder_done;
+	int writer_failed;
+	int read_errno;
+	capture_stats* stats;
+} pipeline;
+
+static int done(int* flag)
+{
+	return __atomic_load_n(flag, __ATOMIC_ACQUIRE);
+}
+
+static void set_done(int* flag)
+{
+	__atomic_store_n(flag, 1, __ATOMIC_RELEASE);
+}
+
+static void* reader(void* arg)
+{
+	pipeline* p = arg;
+	static char buf[65536];
+	while ( !stop ) {
+		int n = source_read(&p->src, buf, sizeof(buf), 100);
+		if ( n < 0 ) {
+			p->read_errno = errno;
+			break;
+		}
+		size_t w = ring_write(&p->raw, buf, n);
+		p->stats->bytes += n;
+		p->stats->dropped += n - w;
+	}
+	p->stats->ring_high = p->raw.high;
+	set_done(&p->reader_done);
+	return 0;
+}
+
+// Hands the current chunk to the writer and takes an empty one back.
+static void pass_chunk(pipeline* p)
+{
+	while ( !ring_write(&p->full, &p->cur, 1) ) {
+		if ( done(&p->writer_failed) ) {
+			p->cur->n = p->cur->buflen = 0;	// nowhere to go, keep decoding
+			return;
+		}
+		usleep(CAPTURE_POLL_US);
+	}
+	while ( !ring_read(&p->empty, &p->cur, 1) ) {
+		usleep(CAPTURE_POLL_US);
+	}
+}
+
+static void decode_event(void* ctx, const trace_event* ev)
+{
+	pipeline* p = ctx;
+	// Time can go backwards after dropped bytes. The writer refuses a chunk
+	// that starts before the last one ended, and the capture with it, so
+	// check across chunks and not just within one.
+	if ( ev->t < p->t_last ) {
+		++p->stats->backwards;
+		return;
+	}
+	if ( sct_encoder_put(p->cur, ev) ) {
+		return;
+	}
+	p->t_last = ev->t;
+	if ( p->cur->n == SCT_CHUNK_EVENTS ) {
+		pass_chunk(p);
+	}
+}
+
+static void decode_byte(void* ctx, const trace_byte* b)
+{
+	pipeline* p = ctx;
+	if ( p->ps2_errno ) {
+		return;
+	}
+	if ( !p->ps2 && !(p->ps2 = fopen(p->ps2_path, "w")) ) {
+		p->ps2_errno = errno;
+		return;
+	}
+	decode_frame f;
+	ps2_frame_from_byte(b, p->tick_hz, &f);
+	decode_frame_print(p->ps2, &ps2_decoder_ops, p->tick_hz, &f);
+	++p->stats->ps2_bytes;
+}
+
+// Device stats and profile lines are the live measure of how close the
+// capture is to losing events, so pass them straight on.
+static void decode_stats(void* ctx, const char* line)
+{
+	fprintf(stderr, "%s\n", line);
+}
+
+static void* decoder(void* arg)
+{
+	pipeline* p = arg;
+	static char buf[65536];
+	while ( 1 ) {
+		size_t n = ring_read(&p->raw, buf, sizeof(buf));
+		if ( n ) {
+			trace_parser_feed(&p->parser, buf, n);
+		} else if ( done(&p->reader_done) && !ring_used(&p->raw) ) {
+			break;
+		} else {
+			usleep(CAPTURE_POLL_US);
+		}
+	}
+	trace_parser_finish(&p->parser);
+	if ( p->cur->n ) {
+		pass_chunk(p);
+	}
+	p->stats->tokens = p->parser.tokens;
+	p->stats->skipped = p->parser.skipped;
+	set_done(&p->decoder_done);
+	return 0;
+}
+
+static int writer(pipeline* p, sct_writer* w)
+{
+	int rc = 0;
+	while ( 1 ) {
+		sct_encoder* e;
+		if ( ring_read(&p->full, &e, 1) ) {
+			if ( !rc && sct_writer_chunk(w, e) ) {
+				rc = -1;
+				set_done(&p->writer_failed);
+			}
+			e->n = e->buflen = 0;
+			ring_write(&p->empty, &e, 1);
+			++p->stats->chunks;
+		} else if ( done(&p->decoder_done) && !ring_used(&p->full) ) {
+			break;
+		} else {
+			usleep(CAPTURE_POLL_US);
+		}
+	}
+	return rc;
+}
+
+int capture_run(const capture_config* cfg, capture_stats* stats)
+{
+	static pipeline p;
+	memset(&p, 0, sizeof(p));
+	memset(stats, 0, sizeof(*stats));
+	p.stats = stats;
+	stop = 0;
+
+	int rc = -1;
+	int err = 0;
+	sct_writer w;
+	if ( source_open(&p.src, cfg->source) ) {
+		return -1;
+	}
+	if ( ring_init(&p.raw, 1, cfg->ring_bytes) || ring_init(&p.full, sizeof(sct_encoder*), CAPTURE_CHUNKS)
+	  || ring_init(&p.empty, sizeof(sct_encoder*), CAPTURE_CHUNKS) ) {
+		err = ENOMEM;
+		goto out;
+	}
+	for ( int i = 0; i < CAPTURE_CHUNKS; ++i ) {
+		if ( sct_encoder_init(&p.chunks[i]) ) {
+			err = ENOMEM;
+			goto out;
+		}
+		sct_encoder* e = &p.chunks[i];
+		if ( i ) {
+			ring_write(&p.empty, &e, 1);
+		}
+	}
+	p.cur = &p.chunks[0];
+	trace_parser_init(&p.parser, decode_event, &p);
+	trace_parser_on_stats(&p.parser, decode_stats, &p);
+	trace_parser_on_byte(&p.parser, decode_byte, &p);
+	p.tick_hz = cfg->tick_hz;
+	if ( snprintf(p.ps2_path, sizeof(p.ps2_path), "%s%s", cfg->out, CAPTURE_PS2_SUFFIX) >= (int)sizeof(p.ps2_path) ) {
+		err = ENAMETOOLONG;
+		goto out;
+	}
+	if ( sct_writer_open(&w, cfg->out, cfg->port, cfg->tick_hz) ) {
+		err = errno;
+		goto out;
+	}
+
+	pthread_t rt, dt;
+	if ( pthread_create(&rt, 0, reader, &p) ) {
+		err = EAGAIN;
+		sct_writer_close(&w);
+		goto out;
+	}
+	if ( pthread_create(&dt, 0, decoder, &p) ) {
+		stop = 1;
+		pthread_join(rt, 0);
+		err = EAGAIN;
+		sct_writer_close(&w);
+		goto out;
+	}
+	rc = writer(&p, &w);
+	err = errno;
+	pthread_join(rt, 0);
+	pthread_join(dt, 0);
+	if ( sct_writer_close(&w) && !rc ) {
+		rc = -1;
+		err = errno;
+	}
+	if ( !rc && p.read_errno ) {
+		rc = -1;
+		err = p.read_errno;
+	}
+	if ( p.ps2 ) {
+		int bad = ferror(p.ps2);
+		errno = 0;
+		if ( fclose(p.ps2) || bad ) {
+			p.ps2_errno = errno ? errno : EIO;
+		}
+	}
+	if ( !rc && p.ps2_errno ) {
+		rc = -1;
+		err = p.ps2_errno;
+	}
+
+out:
+	for ( int i = 0; i < CAPTURE_CHUNKS; ++i ) {
+		sct_encoder_free(&p.chunks[i]);
+	}
+	ring_free(&p.raw);
+	ring_free(&p.full);
+	ring_free(&p.empty);
+	source_close(&p.src);
+	errno = err;
+	return rc;
+}
@@ -0,0 +1,51 @@
+#ifndef capture_h__
+#define capture_h__
+
+// Live capture to a .sct file.
+//
+// Three threads joined by SPSC rings:
+//	reader	source -> raw byte ring; never waits on anything but the device,
+//			and if the ring is full the bytes are counted as dropped
+//	decoder	raw ring -> trace_parser -> encoded chunks
+//	writer	encoded chunks -> file, handing each chunk buffer back to the
+//			decoder through a second ring once written
+// A stalled disk therefore backs up into the (large) raw ring instead of
+// holding up USB reads.
+//
+// Bytes decoded by PS2_DECODE_ENABLE firmware have no edges to go in the
+// .sct file, so the decoder writes them to a text file next to it, named
+// out + CAPTURE_PS2_SUFFIX, in the form "sctool ps2" prints. The file is
+// only made if the device sends any.
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CAPTURE_PS2_SUFFIX	".ps2"
+
+typedef struct capture_config {
+	const char* source;		// see source_open()
+	const char* out;
+	char port;
+	uint32_t tick_hz;
+	size_t ring_bytes;		// raw ring size
+} capture_config;
+
+typedef struct capture_stats {
+	uint64_t bytes;			// read from the source
+	uint64_t dropped;		// bytes that didn't fit in the raw ring
+	uint64_t ring_high;		// raw ring high water mark
+	uint64_t tokens;		// events parsed
+	uint64_t skipped;		// other tokens
+	uint64_t backwards;		// events earlier than the one before, not written
+	uint64_t ps2_bytes;		// decoded by the device, see CAPTURE_PS2_SUFFIX
+	uint64_t chunks;		// written
+} capture_stats;
+
+// Captures until the source ends or capture_stop() is called. Returns 0 on
+// success, -1 with errno set.
+int capture_run(const capture_config* cfg, capture_stats* stats);
+
+// Ends a capture_run() in progress; safe to call from a signal handler.
+void capture_stop(void);
+
+#endif
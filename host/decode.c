@@ -0,0 +1,232 @@
+// Decoder registry and the parallel chunk driver.
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "decode.h"
+#include "ps2.h"
+#include "xt.h"
+
+static const decoder_ops* const decoders[] = {
+	&ps2_decoder_ops,
+	&xt_decoder_ops,
+};
+
+const decoder_ops* decoder_find(const char* name)
+{
+	for ( size_t i = 0; i < sizeof(decoders) / sizeof(decoders[0]); ++i ) {
+		if ( !strcmp(decoders[i]->name, name) ) {
+			return decoders[i];
+		}
+	}
+	return 0;
+}
+
+void decode_frame_print(FILE* f, const decoder_ops* ops, uint32_t tick_hz, const decode_frame* fr)
+{
+	double us = 1e6 / tick_hz;
+	char flags[64];
+	fprintf(f, "%14.3f %-6s %02X", fr->t * us, ops->dir_str(fr->dir), fr->value);
+	if ( fr->max_period ) {
+		fprintf(f, "  clock %.1f-%.1f us", fr->min_period * us, fr->max_period * us);
+	}
+	if ( fr->min_setup || fr->min_hold ) {
+		fprintf(f, "  setup %.1f hold %.1f us", fr->min_setup * us, fr->min_hold * us);
+	}
+	if ( fr->flags ) {
+		fprintf(f, "  %s (%u bits)", ops->flags_str(fr->flags, flags, sizeof(flags)), fr->bits);
+	}
+	fputc('\n', f);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// parallel driver
+
+typedef struct segment {
+	uint32_t c0;			// chunks [c0, c1)
+	uint32_t c1;
+	uint64_t t_start;		// frames starting in [t_start, t_end) belong here
+	uint64_t t_end;
+	decode_frame* frames;
+	size_t n;
+	size_t cap;
+	int err;
+	int done;
+} segment;
+
+typedef struct pool {
+	sct_reader* r;
+	const decoder_ops* ops;
+	const decoder_config* cfg;
+	uint64_t overlap;
+	segment* segs;
+	uint32_t nsegs;
+	uint32_t next;			// next segment to hand out
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} pool;
+
+static void collect(void* ctx, const decode_frame* f)
+{
+	segment* s = ctx;
+	if ( f->t < s->t_start || f->t >= s->t_end || s->err ) {
+		return;
+	}
+	if ( s->n == s->cap ) {
+		size_t cap = s->cap ? s->cap * 2 : 1024;
+		decode_frame* p = realloc(s->frames, cap * sizeof(*p));
+		if ( !p ) {
+			s->err = ENOMEM;
+			return;
+		}
+		s->frames = p;
+		s->cap = cap;
+	}
+	s->frames[s->n++] = *f;
+}
+
+static void decode_segment(pool* p, segment* s, void* d, trace_event* events)
+{
+	const sct_info* info = &p->r->info;
+	uint32_t c = s->c0;
+	decoder_config cfg = *p->cfg;
+	if ( s->c0 ) {
+		c = sct_find_chunk(p->r, s->t_start > p->overlap ? s->t_start - p->overlap : 0);
+	}
+	if ( c ) {
+		cfg.t_reset = UINT64_MAX;	// only the worker starting at the beginning sees it
+	}
+	p->ops->init(d, &cfg, collect, s);
+	for ( ; c < info->nchunks; ++c ) {
+		int n = sct_decode_chunk(p->r, c, events);
+		if ( n < 0 ) {
+			s->err = EINVAL;
+			return;
+		}
+		for ( int i = 0; i < n; ++i ) {
+			// past our segment, stop at the first resync point
+			if ( events[i].t >= s->t_end && p->ops->idle(d) ) {
+				return;
+			}
+			p->ops->event(d, &events[i]);
+		}
+	}
+	p->ops->finish(d);
+}
+
+static void* worker(void* arg)
+{
+	pool* p = arg;
+	void* d = malloc(p->ops->size);
+	trace_event* events = malloc(p->r->info.chunk_events * sizeof(trace_event));
+	while ( 1 ) {
+		pthread_mutex_lock(&p->lock);
+		uint32_t i = p->next++;
+		pthread_mutex_unlock(&p->lock);
+		if ( i >= p->nsegs ) {
+			break;
+		}
+		segment* s = &p->segs[i];
+		if ( d && events ) {
+			decode_segment(p, s, d, events);
+		} else {
+			s->err = ENOMEM;
+		}
+		pthread_mutex_lock(&p->lock);
+		s->done = 1;
+		pthread_cond_broadcast(&p->cond);
+		pthread_mutex_unlock(&p->lock);
+	}
+	free(events);
+	free(d);
+	return 0;
+}
+
+int decode_parallel(sct_reader* r, const decoder_ops* ops, const decoder_config* cfg,
+	unsigned nthreads, uint64_t overlap_ticks, decode_frame_fn fn, void* ctx)
+{
+	uint32_t nchunks = r->info.nchunks;
+	if ( !nchunks ) {
+		return 0;
+	}
+	if ( !nthreads ) {
+		nthreads = 1;
+	}
+	// several segments per thread so a slow segment doesn't hold up the rest
+	uint32_t nsegs = nthreads * 8;
+	if ( nsegs > nchunks ) {
+		nsegs = nchunks;
+	}
+	pool p;
+	memset(&p, 0, sizeof(p));
+	p.r = r;
+	p.ops = ops;
+	p.cfg = cfg;
+	p.overlap = overlap_ticks;
+	p.nsegs = nsegs;
+	p.segs = calloc(nsegs, sizeof(segment));
+	pthread_t* threads = calloc(nthreads, sizeof(pthread_t));
+	if ( !p.segs || !threads ) {
+		free(p.segs);
+		free(threads);
+		errno = ENOMEM;
+		return -1;
+	}
+	for ( uint32_t i = 0; i < nsegs; ++i ) {
+		segment* s = &p.segs[i];
+		s->c0 = (uint64_t)nchunks * i / nsegs;
+		s->c1 = (uint64_t)nchunks * (i + 1) / nsegs;
+		sct_index_entry e;
+		sct_chunk_entry(r, s->c0, &e);
+		s->t_start = i ? e.t0 : 0;
+		s->t_end = UINT64_MAX;
+		if ( s->c1 < nchunks ) {
+			sct_chunk_entry(r, s->c1, &e);
+			s->t_end = e.t0;
+		}
+	}
+	pthread_mutex_init(&p.lock, 0);
+	pthread_cond_init(&p.cond, 0);
+	unsigned started = 0;
+	for ( ; started < nthreads; ++started ) {
+		if ( pthread_create(&threads[started], 0, worker, &p) ) {
+			break;
+		}
+	}
+	if ( !started ) {
+		worker(&p);		// no threads available, do it here
+	}
+
+	// hand back results in order as segments complete
+	int err = 0;
+	for ( uint32_t i = 0; i < nsegs; ++i ) {
+		segment* s = &p.segs[i];
+		pthread_mutex_lock(&p.lock);
+		while ( !s->done ) {
+			pthread_cond_wait(&p.cond, &p.lock);
+		}
+		pthread_mutex_unlock(&p.lock);
+		if ( s->err && !err ) {
+			err = s->err;
+		}
+		for ( size_t k = 0; k < s->n; ++k ) {
+			fn(ctx, &s->frames[k]);
+		}
+		free(s->frames);
+		s->frames = 0;
+	}
+
+	for ( unsigned i = 0; i < started; ++i ) {
+		pthread_join(threads[i], 0);
+	}
+	pthread_cond_destroy(&p.cond);
+	pthread_mutex_destroy(&p.lock);
+	free(threads);
+	free(p.segs);
+	if ( err ) {
+		errno = err;
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,69 @@
+#ifndef decode_h__
+#define decode_h__
+
+// Protocol decoder interface and the drivers that run decoders over a trace.
+//
+// A decoder is a state machine fed one event at a time that reports frames
+// through a callback. To decode a .sct file in parallel the chunks are split
+// into segments, each decoded on a worker thread starting a little before
+// the segment (the overlap) so the decoder has resynchronised by the time it
+// reaches the segment start. Frames starting before the segment are dropped,
+// and a worker runs past the end of its segment until the decoder is between
+// frames, so every frame is reported by exactly one worker. Results are
+// stitched back together in order.
+
+#include <stdio.h>
+#include "trace.h"
+#include "sctfile.h"
+
+typedef struct decode_frame {
+	uint64_t t;				// start of the frame
+	uint64_t t_end;			// last clock edge
+	uint32_t min_period;	// between sampling clock edges, in ticks
+	uint32_t max_period;
+	uint32_t min_setup;		// data stable before a sampling edge, 0 if not measured
+	uint32_t min_hold;		// data stable after a sampling edge, 0 if not measured
+	uint8_t value;
+	uint8_t dir;			// decoder specific, e.g. PS2_DEVICE
+	uint8_t flags;			// decoder specific errors and events
+	uint8_t bits;			// clock edges seen
+} decode_frame;
+
+typedef void (*decode_frame_fn)(void* ctx, const decode_frame* f);
+
+#define DECODE_NO_CHANNEL	0xFF
+
+typedef struct decoder_config {
+	uint8_t clk;			// channel numbers
+	uint8_t dat;
+	uint8_t rst;			// reset line, DECODE_NO_CHANNEL if not captured
+	uint32_t tick_hz;
+	uint64_t t_reset;		// time of a reset not in the trace (UINT64_MAX if none)
+} decoder_config;
+
+typedef struct decoder_ops {
+	const char* name;
+	size_t size;			// of the decoder state
+	void (*init)(void* d, const decoder_config* cfg, decode_frame_fn fn, void* ctx);
+	void (*event)(void* d, const trace_event* ev);
+	void (*finish)(void* d);
+	// Resync point: the decoder is between frames (safe to stop feeding it).
+	int (*idle)(const void* d);
+	// Formats frame flags, e.g. "parity,stop".
+	const char* (*flags_str)(uint8_t flags, char* buf, size_t len);
+	const char* (*dir_str)(uint8_t dir);
+} decoder_ops;
+
+// Looks up a decoder by name, 0 if unknown.
+const decoder_ops* decoder_find(const char* name);
+
+// Prints a frame as a line of text: start time in us, direction, value, then
+// clock, setup/hold and error details where there are any.
+void decode_frame_print(FILE* f, const decoder_ops* ops, uint32_t tick_hz, const decode_frame* fr);
+
+// Decodes a whole .sct file on nthreads threads, calling fn in time order
+// from the calling thread. overlap_ticks is the resync lead-in per segment.
+int decode_parallel(sct_reader* r, const decoder_ops* ops, const decoder_config* cfg,
+	unsigned nthreads, uint64_t overlap_ticks, decode_frame_fn fn, void* ctx);
+
+#endif
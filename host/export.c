@@ -0,0 +1,340 @@
+// VCD and sigrok session writers.
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "export.h"
+
+// Number of channels present in a channel mask.
+static uint8_t channel_count(uint16_t mask)
+{
+	uint8_t n = 0;
+	for ( ; mask; mask &= mask - 1 ) {
+		++n;
+	}
+	return n;
+}
+
+static uint64_t ticks_scale(uint64_t t, uint64_t num, uint64_t den)
+{
+	return (uint64_t)((unsigned __int128)t * num / den);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Value Change Dump
+
+// VCD identifiers are printable characters from '!'.
+#define VCD_ID(n) ((char)('!' + (n)))
+
+int vcd_begin(vcd_writer* v, FILE* f, char port, uint32_t tick_hz)
+{
+	memset(v, 0, sizeof(*v));
+	v->f = f;
+	v->port = port;
+	v->tick_hz = tick_hz;
+	v->mask = trace_channel_mask(port);
+
+	time_t now = time(0);
+	fprintf(f, "$date %.24s $end\n", ctime(&now));
+	fprintf(f, "$version sctool (CAPTURE_PORT %c, %u Hz) $end\n", port, tick_hz);
+	fprintf(f, "$timescale 1ps $end\n");
+	fprintf(f, "$scope module sctrace $end\n");
+	for ( uint8_t n = 0; n < 16; ++n ) {
+		if ( v->mask & (1 << n) ) {
+			fprintf(f, "$var wire 1 %c %s $end\n", VCD_ID(n), trace_channel_name(port, n));
+		}
+	}
+	fprintf(f, "$upscope $end\n$enddefinitions $end\n");
+	return ferror(f) ? -1 : 0;
+}
+
+int vcd_event(vcd_writer* v, const trace_event* ev)
+{
+	uint16_t pins = ev->pins & v->mask;
+	if ( !v->started ) {
+		v->started = 1;
+		v->t0 = ev->t;
+		v->t_out = ev->t;
+		fprintf(v->f, "#0\n$dumpvars\n");
+		for ( uint8_t n = 0; n < 16; ++n ) {
+			if ( v->mask & (1 << n) ) {
+				fprintf(v->f, "%c%c\n", (pins & (1 << n)) ? '1' : '0', VCD_ID(n));
+			}
+		}
+		fprintf(v->f, "$end\n");
+	} else if ( pins != v->pins ) {
+		v->t_out = ev->t;
+		fprintf(v->f, "#%llu\n", (unsigned long long)ticks_scale(ev->t - v->t0, 1000000000000ULL, v->tick_hz));
+		for ( uint16_t changed = pins ^ v->pins; changed; changed &= changed - 1 ) {
+			uint8_t n = __builtin_ctz(changed);
+			fprintf(v->f, "%c%c\n", (pins & (1 << n)) ? '1' : '0', VCD_ID(n));
+		}
+	}
+	v->pins = pins;
+	v->t_last = ev->t;
+	return ferror(v->f) ? -1 : 0;
+}
+
+int vcd_end(vcd_writer* v)
+{
+	if ( v->started && v->t_last != v->t_out ) {
+		// timer events may extend the trace past the last change
+		fprintf(v->f, "#%llu\n", (unsigned long long)ticks_scale(v->t_last - v->t0, 1000000000000ULL, v->tick_hz));
+	}
+	return fflush(v->f) || ferror(v->f) ? -1 : 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// zip container (stored entries only)
+
+static uint32_t crc_table[256];
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t* p, size_t len)
+{
+	if ( !crc_table[1] ) {
+		for ( uint32_t i = 0; i < 256; ++i ) {
+			uint32_t c = i;
+			for ( int k = 0; k < 8; ++k ) {
+				c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+			}
+			crc_table[i] = c;
+		}
+	}
+	crc = ~crc;
+	while ( len-- ) {
+		crc = crc_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+static void le16(uint8_t* p, uint16_t v)
+{
+	p[0] = v; p[1] = v >> 8;
+}
+
+static void le32(uint8_t* p, uint32_t v)
+{
+	p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+static void dos_time(uint16_t* t, uint16_t* d)
+{
+	time_t now = time(0);
+	struct tm* tm = localtime(&now);
+	*t = (tm->tm_hour << 11) | (tm->tm_min << 5) | (tm->tm_sec / 2);
+	*d = ((tm->tm_year - 80) << 9) | ((tm->tm_mon + 1) << 5) | tm->tm_mday;
+}
+
+static int zip_add(sr_writer* s, const char* name, const uint8_t* data, uint32_t size)
+{
+	if ( s->err ) {
+		return -1;
+	}
+	size_t namelen = strlen(name);
+	if ( (uint64_t)s->offset + 30 + namelen + size > 0xFFFFFFFFUL ) {
+		s->err = EFBIG;		// no zip64; lower the sample rate for very long captures
+		return -1;
+	}
+	if ( s->nentries == s->entries_cap ) {
+		uint32_t cap = s->entries_cap ? s->entries_cap * 2 : 64;
+		sr_entry* p = realloc(s->entries, cap * sizeof(*p));
+		if ( !p ) {
+			s->err = ENOMEM;
+			return -1;
+		}
+		s->entries = p;
+		s->entries_cap = cap;
+	}
+	sr_entry* e = &s->entries[s->nentries++];
+	e->offset = s->offset;
+	e->size = size;
+	e->crc = crc32_update(0, data, size);
+	snprintf(e->name, sizeof(e->name), "%s", name);
+
+	uint16_t t, d;
+	dos_time(&t, &d);
+	uint8_t h[30];
+	le32(h, 0x04034B50);
+	le16(h + 4, 20);		// version needed
+	le16(h + 6, 0);			// flags
+	le16(h + 8, 0);			// stored
+	le16(h + 10, t);
+	le16(h + 12, d);
+	le32(h + 14, e->crc);
+	le32(h + 18, size);
+	le32(h + 22, size);
+	le16(h + 26, namelen);
+	le16(h + 28, 0);
+	if ( fwrite(h, 30, 1, s->f) != 1 || fwrite(name, namelen, 1, s->f) != 1
+	  || (size && fwrite(data, size, 1, s->f) != 1) ) {
+		s->err = errno ? errno : EIO;
+		return -1;
+	}
+	s->offset += 30 + namelen + size;
+	return 0;
+}
+
+static int zip_finish(sr_writer* s)
+{
+	uint16_t t, d;
+	dos_time(&t, &d);
+	uint32_t cd_offset = s->offset;
+	uint32_t cd_size = 0;
+	for ( uint32_t i = 0; i < s->nentries && !s->err; ++i ) {
+		const sr_entry* e = &s->entries[i];
+		size_t namelen = strlen(e->name);
+		uint8_t h[46];
+		memset(h, 0, sizeof(h));
+		le32(h, 0x02014B50);
+		le16(h + 4, 20);	// version made by
+		le16(h + 6, 20);	// version needed
+		le16(h + 12, t);
+		le16(h + 14, d);
+		le32(h + 16, e->crc);
+		le32(h + 20, e->size);
+		le32(h + 24, e->size);
+		le16(h + 28, namelen);
+		le32(h + 42, e->offset);
+		if ( fwrite(h, 46, 1, s->f) != 1 || fwrite(e->name, namelen, 1, s->f) != 1 ) {
+			s->err = errno ? errno : EIO;
+		}
+		cd_size += 46 + namelen;
+	}
+	uint8_t h[22];
+	memset(h, 0, sizeof(h));
+	le32(h, 0x06054B50);
+	le16(h + 8, s->nentries);
+	le16(h + 10, s->nentries);
+	le32(h + 12, cd_size);
+	le32(h + 16, cd_offset);
+	if ( !s->err && fwrite(h, 22, 1, s->f) != 1 ) {
+		s->err = errno ? errno : EIO;
+	}
+	return s->err ? -1 : 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// sigrok session
+
+static int sr_flush_chunk(sr_writer* s)
+{
+	char name[16];
+	snprintf(name, sizeof(name), "logic-1-%u", s->nentries - 1);	// after version, metadata
+	int rc = zip_add(s, name, s->buf, s->buflen);
+	s->buflen = 0;
+	return rc;
+}
+
+int sr_begin(sr_writer* s, const char* path, char port, uint32_t tick_hz, uint32_t samplerate)
+{
+	memset(s, 0, sizeof(*s));
+	s->port = port;
+	s->tick_hz = tick_hz;
+	s->samplerate = samplerate;
+	uint16_t mask = trace_channel_mask(port);
+	s->unitsize = (channel_count(mask) + 7) / 8;
+	s->buf = malloc(SR_CHUNK_SIZE);
+	if ( !s->buf ) {
+		return -1;
+	}
+	s->f = fopen(path, "wb");
+	if ( !s->f ) {
+		free(s->buf);
+		return -1;
+	}
+
+	zip_add(s, "version", (const uint8_t*)"2", 1);
+
+	char meta[1024];
+	int len = snprintf(meta, sizeof(meta),
+		"[global]\nsigrok version=0.5.1\n\n"
+		"[device 1]\ncapturefile=logic-1\ntotal probes=%u\nsamplerate=%u Hz\n"
+		"total analog=0\nunitsize=%u\n",
+		channel_count(mask), samplerate, s->unitsize);
+	uint8_t probe = 1;
+	for ( uint8_t n = 0; n < 16; ++n ) {
+		if ( mask & (1 << n) ) {
+			len += snprintf(meta + len, sizeof(meta) - len, "probe%u=%s\n", probe++, trace_channel_name(port, n));
+		}
+	}
+	zip_add(s, "metadata", (const uint8_t*)meta, len);
+	return s->err ? -1 : 0;
+}
+
+// Packs the present channels into consecutive sample bits.
+static uint16_t sample_value(const sr_writer* s, uint16_t pins)
+{
+	uint16_t mask = trace_channel_mask(s->port);
+	uint16_t v = 0;
+	uint8_t bit = 0;
+	for ( ; mask; mask &= mask - 1 ) {
+		if ( pins & mask & -mask ) {
+			v |= 1 << bit;
+		}
+		++bit;
+	}
+	return v;
+}
+
+static int sr_fill(sr_writer* s, uint64_t count)
+{
+	uint16_t v = sample_value(s, s->pins);
+	while ( count && !s->err ) {
+		uint64_t room = (SR_CHUNK_SIZE - s->buflen) / s->unitsize;
+		uint32_t n = count < room ? count : room;
+		uint8_t* p = s->buf + s->buflen;
+		if ( s->unitsize == 1 ) {
+			memset(p, v, n);
+		} else {
+			for ( uint32_t i = 0; i < n; ++i ) {
+				p[2 * i] = v;
+				p[2 * i + 1] = v >> 8;
+			}
+		}
+		s->buflen += n * s->unitsize;
+		s->sample += n;
+		count -= n;
+		if ( s->buflen + s->unitsize > SR_CHUNK_SIZE ) {
+			sr_flush_chunk(s);
+		}
+	}
+	return s->err ? -1 : 0;
+}
+
+int sr_event(sr_writer* s, const trace_event* ev)
+{
+	if ( !s->started ) {
+		s->started = 1;
+		s->t0 = ev->t;
+		s->pins = ev->pins;
+		return 0;
+	}
+	uint64_t sample = ticks_scale(ev->t - s->t0, s->samplerate, s->tick_hz);
+	if ( sample > s->sample && sr_fill(s, sample - s->sample) ) {
+		return -1;
+	}
+	s->pins = ev->pins;
+	return 0;
+}
+
+int sr_end(sr_writer* s)
+{
+	if ( s->started ) {
+		sr_fill(s, 1);		// the final state
+	}
+	if ( s->buflen ) {
+		sr_flush_chunk(s);
+	}
+	zip_finish(s);
+	if ( fclose(s->f) && !s->err ) {
+		s->err = errno;
+	}
+	free(s->buf);
+	free(s->entries);
+	if ( s->err ) {
+		errno = s->err;
+		return -1;
+	}
+	return 0;
+}
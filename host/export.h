@@ -0,0 +1,68 @@
+#ifndef export_h__
+#define export_h__
+
+// Streaming exporters for waveform viewers. Both keep only the current pin
+// state, so memory use doesn't depend on the length of the trace.
+//
+// VCD (GTKWave, PulseView) is written as events arrive and can be viewed
+// while a capture is still running. sigrok .sr sessions are zip files of
+// sampled data; the central directory is only written by sr_end().
+
+#include <stdio.h>
+#include "trace.h"
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Value Change Dump
+
+typedef struct vcd_writer {
+	FILE* f;
+	char port;
+	uint32_t tick_hz;
+	uint16_t mask;
+	uint8_t started;
+	uint16_t pins;
+	uint64_t t0;
+	uint64_t t_out;		// last timestamp written
+	uint64_t t_last;
+} vcd_writer;
+
+int vcd_begin(vcd_writer* v, FILE* f, char port, uint32_t tick_hz);
+int vcd_event(vcd_writer* v, const trace_event* ev);
+int vcd_end(vcd_writer* v);
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// sigrok session
+
+#define SR_CHUNK_SIZE	(4UL << 20)		// bytes per logic-1-N file, as sigrok writes them
+
+typedef struct sr_entry {
+	uint32_t offset;
+	uint32_t size;
+	uint32_t crc;
+	char name[16];
+} sr_entry;
+
+typedef struct sr_writer {
+	FILE* f;
+	char port;
+	uint32_t tick_hz;
+	uint32_t samplerate;
+	uint8_t unitsize;		// bytes per sample
+	uint8_t started;
+	uint16_t pins;
+	uint64_t t0;
+	uint64_t sample;		// samples written so far
+	uint8_t* buf;			// current logic-1-N chunk
+	uint32_t buflen;
+	uint32_t offset;		// zip file offset
+	sr_entry* entries;
+	uint32_t nentries;
+	uint32_t entries_cap;
+	int err;
+} sr_writer;
+
+int sr_begin(sr_writer* s, const char* path, char port, uint32_t tick_hz, uint32_t samplerate);
+int sr_event(sr_writer* s, const trace_event* ev);
+int sr_end(sr_writer* s);
+
+#endif
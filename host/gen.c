@@ -0,0 +1,246 @@
+// Synthetic keyboard traffic.
+
+#include <string.h>
+#include "gen.h"
+
+// Scan codes for a to z, set 2 and XT (set 1).
+static const uint8_t ps2_codes[26] = {
+	0x1C, 0x32, 0x21, 0x23, 0x24, 0x2B, 0x34, 0x33, 0x43, 0x3B, 0x42, 0x4B, 0x3A,
+	0x31, 0x44, 0x4D, 0x15, 0x2D, 0x1B, 0x2C, 0x3C, 0x2A, 0x1D, 0x22, 0x35, 0x1A
+};
+static const uint8_t xt_codes[26] = {
+	0x1E, 0x30, 0x2E, 0x20, 0x12, 0x21, 0x22, 0x23, 0x17, 0x24, 0x25, 0x26, 0x32,
+	0x31, 0x18, 0x19, 0x10, 0x13, 0x1F, 0x14, 0x16, 0x2F, 0x11, 0x2D, 0x15, 0x2C
+};
+
+void gen_config_init(gen_config* c)
+{
+	memset(c, 0, sizeof(*c));
+	c->proto = GEN_PS2;
+	c->clk = 0;
+	c->dat = 1;
+	c->tick_hz = TRACE_TICK_HZ;
+	c->clock_hz = 12500;
+	c->key_rate = 10;
+	c->seed = 1;
+}
+
+typedef struct gen {
+	const gen_config* c;
+	trace_event_fn fn;
+	void* ctx;
+	uint64_t t_end;
+	uint64_t max_events;
+	uint64_t n;				// edges out
+	int done;
+	uint64_t rng;
+	uint16_t clk;			// channel masks
+	uint16_t dat;
+	uint16_t pins;
+	uint64_t t;				// latest edge
+	uint64_t us;			// ticks
+	uint64_t half;			// clock half period, in ticks
+	uint64_t glitch_mean;	// ticks between glitches on average, 0 for none
+	uint64_t t_glitch;		// next glitch
+} gen;
+
+// xorshift64*
+static uint64_t rnd(gen* g)
+{
+	g->rng ^= g->rng >> 12;
+	g->rng ^= g->rng << 25;
+	g->rng ^= g->rng >> 27;
+	return g->rng * 0x2545F4914F6CDD1DULL;
+}
+
+static uint64_t rnd_below(gen* g, uint64_t n)
+{
+	return n ? rnd(g) % n : 0;
+}
+
+// A random gap, mean ticks on average.
+static uint64_t rnd_gap(gen* g, uint64_t mean)
+{
+	return 1 + rnd_below(g, 2 * mean);
+}
+
+static uint64_t rate_mean(const gen* g, double rate)
+{
+	return (rate > 0) ? (uint64_t)(g->c->tick_hz / rate) : 0;
+}
+
+static void emit(gen* g, uint64_t t, uint16_t pins)
+{
+	if ( g->done ) {
+		return;
+	}
+	if ( (g->t_end && t > g->t_end) || (g->max_events && g->n == g->max_events) ) {
+		g->done = 1;
+		return;
+	}
+	trace_event ev;
+	ev.t = t;
+	ev.pins = pins;
+	ev.flags = TRACE_EDGE;
+	g->fn(g->ctx, &ev);
+	g->t = t;
+	++g->n;
+}
+
+// Sets a line at about time t, after any glitches due before then.
+static void set(gen* g, uint64_t t, uint16_t mask, int level)
+{
+	uint32_t j = g->c->jitter_ticks;
+	if ( j ) {
+		t = t + rnd_below(g, 2 * j + 1) - j;
+	}
+	while ( g->glitch_mean && g->t_glitch + g->c->glitch_ticks < t ) {
+		uint16_t line = (rnd(g) & 1) ? g->clk : g->dat;
+		uint64_t tg = (g->t_glitch > g->t) ? g->t_glitch : g->t + 1;
+		emit(g, tg, g->pins ^ line);
+		emit(g, tg + g->c->glitch_ticks, g->pins);
+		g->t_glitch += rnd_gap(g, g->glitch_mean);
+	}
+	if ( t <= g->t ) {
+		t = g->t + 1;
+	}
+	uint16_t pins = level ? (g->pins | mask) : (g->pins & ~mask);
+	if ( pins != g->pins ) {
+		g->pins = pins;
+		emit(g, t, pins);
+	}
+}
+
+// Clocks out nbits bits, first in bit 0, each set up a quarter of the half
+// period before the falling clock edge it's sampled on. Returns the end.
+static uint64_t send_bits(gen* g, uint64_t t, uint16_t bits, uint8_t nbits)
+{
+	uint64_t setup = g->half / 4;
+	while ( nbits-- ) {
+		set(g, t, g->dat, bits & 1);
+		t += setup;
+		set(g, t, g->clk, 0);
+		t += g->half;
+		set(g, t, g->clk, 1);
+		t += g->half - setup;
+		bits >>= 1;
+	}
+	return t;
+}
+
+static uint16_t odd_parity(uint8_t v)
+{
+	return !__builtin_parity(v);
+}
+
+// Keyboard to host: start (0), 8 data bits, odd parity, stop (1).
+static uint64_t ps2_send(gen* g, uint64_t t, uint8_t v)
+{
+	return send_bits(g, t, 0x400 | (odd_parity(v) << 9) | ((uint16_t)v << 1), 11);
+}
+
+// Host to keyboard: the host inhibits the clock, pulls data low as its
+// request to send and lets go of the clock, then changes data just after
+// each falling edge the keyboard makes, and the keyboard acknowledges.
+static uint64_t ps2_host(gen* g, uint64_t t, uint8_t v)
+{
+	uint64_t us = g->us;
+	set(g, t, g->clk, 0);
+	t += 120 * us;
+	set(g, t, g->dat, 0);
+	t += 10 * us;
+	set(g, t, g->clk, 1);
+	t += 50 * us;
+	set(g, t, g->clk, 0);			// start bit sampled
+	t += 5 * us;
+	uint16_t bits = 0x200 | (odd_parity(v) << 8) | v;
+	for ( uint8_t i = 0; i < 10; ++i, bits >>= 1 ) {
+		set(g, t, g->dat, bits & 1);
+		t += g->half - 5 * us;
+		set(g, t, g->clk, 1);
+		t += g->half;
+		set(g, t, g->clk, 0);
+		t += 5 * us;
+	}
+	set(g, t, g->clk, 1);
+	t += 20 * us;
+	set(g, t, g->dat, 0);			// acknowledge
+	t += 10 * us;
+	set(g, t, g->clk, 0);
+	t += g->half;
+	set(g, t, g->clk, 1);
+	t += 5 * us;
+	set(g, t, g->dat, 1);
+	return t;
+}
+
+// XT: IBM's two start bits (0, then 1) and 8 data bits, then data idles high.
+static uint64_t xt_send(gen* g, uint64_t t, uint8_t v)
+{
+	t = send_bits(g, t, ((uint16_t)v << 2) | 0x002, 10);
+	set(g, t, g->dat, 1);
+	return t;
+}
+
+uint64_t gen_run(const gen_config* c, uint64_t t_end, uint64_t max_events, trace_event_fn fn, void* ctx)
+{
+	gen g;
+	memset(&g, 0, sizeof(g));
+	g.c = c;
+	g.fn = fn;
+	g.ctx = ctx;
+	g.t_end = t_end;
+	g.max_events = max_events;
+	g.rng = c->seed ? c->seed : 1;
+	g.clk = 1 << c->clk;
+	g.dat = 1 << c->dat;
+	g.us = c->tick_hz / 1000000;
+	g.half = c->tick_hz / c->clock_hz / 2;
+	uint64_t key_mean = rate_mean(&g, c->key_rate);
+	uint64_t host_mean = (c->proto == GEN_PS2) ? rate_mean(&g, c->host_rate) : 0;
+	uint64_t gap = 4 * g.half;		// between frames at the least
+	g.glitch_mean = rate_mean(&g, c->glitch_rate);
+	if ( !key_mean && !host_mean ) {
+		return 0;
+	}
+
+	// the lines idle high, which readers need to see before the first change
+	uint64_t t = c->tick_hz / 1000;
+	g.pins = g.clk | g.dat;
+	emit(&g, t, g.pins);
+	uint64_t t_key = key_mean ? t + rnd_gap(&g, key_mean) : UINT64_MAX;
+	uint64_t t_host = host_mean ? t + rnd_gap(&g, host_mean) : UINT64_MAX;
+	g.t_glitch = g.glitch_mean ? t + rnd_gap(&g, g.glitch_mean) : 0;
+
+	while ( !g.done ) {
+		if ( t_host < t_key ) {
+			if ( t < t_host ) {
+				t = t_host;
+			}
+			uint8_t leds = rnd(&g) & 0x07;
+			t = ps2_host(&g, t, 0xED);
+			t = ps2_send(&g, t + gap, 0xFA);
+			t = ps2_host(&g, t + gap, leds);
+			t = ps2_send(&g, t + gap, 0xFA);
+			t_host += rnd_gap(&g, host_mean);
+		} else {
+			if ( t < t_key ) {
+				t = t_key;
+			}
+			uint8_t k = rnd_below(&g, 26);
+			// held for up to half the time to the next key on average
+			uint64_t hold = gap + rnd_below(&g, key_mean / 2);
+			if ( c->proto == GEN_XT ) {
+				t = xt_send(&g, t, xt_codes[k]);
+				t = xt_send(&g, t + hold, xt_codes[k] | 0x80);
+			} else {
+				t = ps2_send(&g, t, ps2_codes[k]);
+				t = ps2_send(&g, t + hold, 0xF0);
+				t = ps2_send(&g, t + gap, ps2_codes[k]);
+			}
+			t_key += rnd_gap(&g, key_mean);
+		}
+		t += gap;
+	}
+	return g.n;
+}
@@ -0,0 +1,46 @@
+#ifndef gen_h__
+#define gen_h__
+
+// Synthetic keyboard traffic, for testing and benchmarking the decoders and
+// the capture pipeline without a keyboard.
+//
+// Keys are typed at random times, on average key_rate a second, each one a
+// make code and, a little later, its break code: PS/2 scan code set 2 (F0,
+// code) or XT (code | 0x80, with IBM's two start bits). PS/2 traffic can
+// also carry AT host commands, on average host_rate a second: ED (set LEDs)
+// and its argument, each acknowledged with FA by the keyboard. Noise moves
+// every edge by up to jitter_ticks and adds glitches, pulses of glitch_ticks
+// on either line, on average glitch_rate a second.
+//
+// The generator only makes edges (TRACE_EDGE events). trace_writer turns
+// them into device output with the overflow markers the firmware would add.
+
+#include "trace.h"
+
+// gen_config.proto
+#define GEN_PS2			0
+#define GEN_XT			1
+
+typedef struct gen_config {
+	uint8_t proto;
+	uint8_t clk;			// channel numbers
+	uint8_t dat;
+	uint32_t tick_hz;
+	uint32_t clock_hz;		// keyboard clock
+	double key_rate;		// keys a second
+	double host_rate;		// host commands a second, PS/2 only
+	double glitch_rate;		// glitches a second
+	uint32_t glitch_ticks;
+	uint32_t jitter_ticks;
+	uint64_t seed;
+} gen_config;
+
+// Defaults: PS/2 on channels 0 and 1 at 12.5kHz, 10 keys a second, no host
+// commands and no noise.
+void gen_config_init(gen_config* c);
+
+// Calls fn for each edge, in time order, until max_events edges or time
+// t_end (either 0 for no limit). Returns the number of edges.
+uint64_t gen_run(const gen_config* c, uint64_t t_end, uint64_t max_events, trace_event_fn fn, void* ctx);
+
+#endif
@@ -0,0 +1,367 @@
+// Level-of-detail index: single pass builder and O(columns) renderer.
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "lod.h"
+
+static void le16(uint8_t* p, uint16_t v) { p[0] = v; p[1] = v >> 8; }
+static void le32(uint8_t* p, uint32_t v) { le16(p, v); le16(p + 2, v >> 16); }
+static void le64(uint8_t* p, uint64_t v) { le32(p, v); le32(p + 4, v >> 32); }
+static uint16_t rd16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+static uint32_t rd32(const uint8_t* p) { return rd16(p) | ((uint32_t)rd16(p + 2) << 16); }
+static uint64_t rd64(const uint8_t* p) { return rd32(p) | ((uint64_t)rd32(p + 4) << 32); }
+
+static void bucket_start(lod_bucket* b, uint16_t pins)
+{
+	memset(b, 0, sizeof(*b));
+	b->first = b->lo = b->hi = pins;
+}
+
+static void bucket_apply(lod_bucket* b, uint16_t prev, uint16_t pins)
+{
+	for ( uint16_t changed = prev ^ pins; changed; changed &= changed - 1 ) {
+		++b->edges[__builtin_ctz(changed)];
+	}
+	b->lo &= pins;
+	b->hi |= pins;
+}
+
+// Pin state at the end of a bucket: each channel toggled once per edge.
+static uint16_t bucket_last(const lod_bucket* b)
+{
+	uint16_t pins = b->first;
+	for ( int n = 0; n < 16; ++n ) {
+		if ( b->edges[n] & 1 ) {
+			pins ^= 1 << n;
+		}
+	}
+	return pins;
+}
+
+// Appends b (which follows a) to a.
+static void bucket_merge(lod_bucket* a, const lod_bucket* b)
+{
+	a->lo &= b->lo;
+	a->hi |= b->hi;
+	for ( int n = 0; n < 16; ++n ) {
+		a->edges[n] += b->edges[n];
+	}
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// builder
+
+#define LOD_WRITE_BUF	65536
+
+typedef struct lod_level {
+	uint64_t offset;		// file position of the next record
+	uint8_t* buf;
+	uint32_t buflen;
+	lod_bucket acc;			// parent bucket being assembled from this level's records
+	uint8_t have;
+} lod_level;
+
+typedef struct lod_builder {
+	int fd;
+	uint16_t mask;
+	uint8_t nlevels;
+	uint32_t recsz;
+	lod_level level[LOD_MAX_LEVELS];
+	int err;
+} lod_builder;
+
+static void level_flush(lod_builder* b, lod_level* lv)
+{
+	if ( lv->buflen && !b->err ) {
+		if ( pwrite(b->fd, lv->buf, lv->buflen, lv->offset) != (ssize_t)lv->buflen ) {
+			b->err = errno ? errno : EIO;
+		}
+	}
+	lv->offset += lv->buflen;
+	lv->buflen = 0;
+}
+
+static void emit(lod_builder* b, uint8_t k, const lod_bucket* r)
+{
+	lod_level* lv = &b->level[k];
+	if ( lv->buflen + b->recsz > LOD_WRITE_BUF ) {
+		level_flush(b, lv);
+	}
+	uint8_t* p = lv->buf + lv->buflen;
+	le16(p, r->first);
+	le16(p + 2, r->lo);
+	le16(p + 4, r->hi);
+	le16(p + 6, 0);
+	p += 8;
+	for ( uint16_t m = b->mask; m; m &= m - 1 ) {
+		le32(p, r->edges[__builtin_ctz(m)]);
+		p += 4;
+	}
+	lv->buflen += b->recsz;
+
+	if ( k + 1 < b->nlevels ) {
+		lod_level* up = &b->level[k + 1];
+		if ( up->have++ ) {
+			bucket_merge(&up->acc, r);
+		} else {
+			up->acc = *r;
+		}
+		if ( up->have == 2 ) {
+			up->have = 0;
+			emit(b, k + 1, &up->acc);
+		}
+	}
+}
+
+int lod_build(sct_reader* r, const char* path, uint8_t base_shift)
+{
+	if ( base_shift > LOD_MAX_SHIFT ) {
+		errno = EINVAL;
+		return -1;
+	}
+	lod_builder b;
+	memset(&b, 0, sizeof(b));
+	b.mask = trace_channel_mask(r->info.port);
+	uint8_t nch = __builtin_popcount(b.mask);
+	b.recsz = LOD_RECORD_SIZE(nch);
+
+	uint64_t t0 = (r->info.t_first >> base_shift) << base_shift;
+	uint64_t n0 = r->info.nevents ? ((r->info.t_last - t0) >> base_shift) + 1 : 0;
+	uint64_t count[LOD_MAX_LEVELS];
+	for ( uint64_t n = n0; n; n = (n + 1) / 2 ) {
+		count[b.nlevels++] = n;
+		if ( n == 1 || b.nlevels == LOD_MAX_LEVELS || base_shift + b.nlevels > LOD_MAX_SHIFT ) {
+			break;
+		}
+	}
+
+	b.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if ( b.fd < 0 ) {
+		return -1;
+	}
+	uint8_t h[LOD_HEADER_SIZE + LOD_MAX_LEVELS * 16];
+	memset(h, 0, sizeof(h));
+	memcpy(h, LOD_MAGIC, 8);
+	le32(h + 8, r->info.tick_hz);
+	h[12] = r->info.port;
+	h[13] = base_shift;
+	h[14] = b.nlevels;
+	h[15] = nch;
+	le16(h + 16, b.mask);
+	le64(h + 24, t0);
+	uint64_t offset = LOD_HEADER_SIZE + b.nlevels * 16;
+	for ( uint8_t k = 0; k < b.nlevels; ++k ) {
+		le64(h + LOD_HEADER_SIZE + k * 16, offset);
+		le64(h + LOD_HEADER_SIZE + k * 16 + 8, count[k]);
+		b.level[k].offset = offset;
+		b.level[k].buf = malloc(LOD_WRITE_BUF);
+		if ( !b.level[k].buf ) {
+			b.err = ENOMEM;
+		}
+		offset += count[k] * b.recsz;
+	}
+	if ( pwrite(b.fd, h, LOD_HEADER_SIZE + b.nlevels * 16, 0) < 0 ) {
+		b.err = errno;
+	}
+
+	if ( n0 && !b.err ) {
+		sct_cursor c;
+		trace_event ev;
+		sct_cursor_seek(&c, r, 0);
+		uint64_t bucket = 0;
+		uint16_t pins = 0;
+		lod_bucket cur;
+		int started = 0;
+		while ( sct_cursor_next(&c, &ev) && !b.err ) {
+			if ( !started ) {
+				started = 1;
+				pins = ev.pins;
+				bucket_start(&cur, pins);
+			}
+			for ( uint64_t eb = (ev.t - t0) >> base_shift; bucket < eb; ++bucket ) {
+				emit(&b, 0, &cur);
+				bucket_start(&cur, pins);
+			}
+			bucket_apply(&cur, pins, ev.pins);
+			pins = ev.pins;
+		}
+		emit(&b, 0, &cur);
+		// push partly assembled parents up through the remaining levels
+		for ( uint8_t k = 1; k < b.nlevels; ++k ) {
+			if ( b.level[k].have ) {
+				b.level[k].have = 0;
+				emit(&b, k, &b.level[k].acc);
+			}
+		}
+	}
+
+	for ( uint8_t k = 0; k < b.nlevels; ++k ) {
+		level_flush(&b, &b.level[k]);
+		free(b.level[k].buf);
+	}
+	if ( close(b.fd) && !b.err ) {
+		b.err = errno;
+	}
+	if ( b.err ) {
+		errno = b.err;
+		return -1;
+	}
+	return 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// reader
+
+int lod_open(lod_index* l, const char* path)
+{
+	memset(l, 0, sizeof(*l));
+	l->fd = open(path, O_RDONLY);
+	if ( l->fd < 0 ) {
+		return -1;
+	}
+	struct stat st;
+	if ( fstat(l->fd, &st) ) {
+		close(l->fd);
+		return -1;
+	}
+	l->size = st.st_size;
+	if ( l->size < LOD_HEADER_SIZE ) {
+		close(l->fd);
+		errno = EINVAL;
+		return -1;
+	}
+	void* map = mmap(0, l->size, PROT_READ, MAP_SHARED, l->fd, 0);
+	if ( map == MAP_FAILED ) {
+		close(l->fd);
+		return -1;
+	}
+	l->map = map;
+	const uint8_t* h = l->map;
+	l->tick_hz = rd32(h + 8);
+	l->port = h[12];
+	l->base_shift = h[13];
+	l->nlevels = h[14];
+	l->nchannels = h[15];
+	l->mask = rd16(h + 16);
+	l->t0 = rd64(h + 24);
+	int ok = !memcmp(h, LOD_MAGIC, 8) && l->nlevels <= LOD_MAX_LEVELS
+		&& l->base_shift <= LOD_MAX_SHIFT && l->base_shift + l->nlevels <= LOD_MAX_SHIFT + 1
+		&& l->nchannels == __builtin_popcount(l->mask)
+		&& l->size >= LOD_HEADER_SIZE + l->nlevels * 16u;
+	for ( uint8_t k = 0; ok && k < l->nlevels; ++k ) {
+		l->offset[k] = rd64(h + LOD_HEADER_SIZE + k * 16);
+		l->count[k] = rd64(h + LOD_HEADER_SIZE + k * 16 + 8);
+		ok = l->offset[k] <= l->size
+			&& l->count[k] <= (l->size - l->offset[k]) / LOD_RECORD_SIZE(l->nchannels);
+	}
+	if ( !ok ) {
+		lod_close(l);
+		errno = EINVAL;
+		return -1;
+	}
+	return 0;
+}
+
+void lod_close(lod_index* l)
+{
+	munmap((void*)l->map, l->size);
+	close(l->fd);
+}
+
+static void read_bucket(const lod_index* l, uint8_t k, uint64_t i, lod_bucket* b)
+{
+	const uint8_t* p = l->map + l->offset[k] + i * LOD_RECORD_SIZE(l->nchannels);
+	memset(b, 0, sizeof(*b));
+	b->first = rd16(p);
+	b->lo = rd16(p + 2);
+	b->hi = rd16(p + 4);
+	p += 8;
+	for ( uint16_t m = l->mask; m; m &= m - 1 ) {
+		b->edges[__builtin_ctz(m)] = rd32(p);
+		p += 4;
+	}
+}
+
+int lod_render(const lod_index* l, uint64_t t0, uint64_t t1, int width, lod_bucket* out)
+{
+	if ( !l->nlevels || t1 <= t0 || width <= 0 ) {
+		return 0;
+	}
+	uint64_t col = (t1 - t0) / width;
+	if ( col < (1ULL << l->base_shift) ) {
+		return 0;
+	}
+	// coarsest level whose buckets still fit in a column
+	uint8_t k = 0;
+	while ( k + 1 < l->nlevels && (1ULL << (l->base_shift + k + 1)) <= col ) {
+		++k;
+	}
+	uint8_t shift = l->base_shift + k;
+	uint64_t last = l->count[k] - 1;
+	for ( int i = 0; i < width; ++i ) {
+		uint64_t a = t0 + (t1 - t0) * i / width;
+		uint64_t b = t0 + (t1 - t0) * (i + 1) / width - 1;
+		// buckets starting within the column, so each bucket lands in exactly one
+		uint64_t ia = a < l->t0 ? 0 : (a - l->t0 + (1ULL << shift) - 1) >> shift;
+		uint64_t ib = b < l->t0 ? 0 : (b - l->t0) >> shift;
+		if ( ia > last ) {
+			// past the end of the trace: hold the final state
+			lod_bucket end;
+			read_bucket(l, k, last, &end);
+			bucket_start(&out[i], bucket_last(&end));
+			continue;
+		}
+		if ( ib > last ) {
+			ib = last;
+		}
+		read_bucket(l, k, ia, &out[i]);
+		for ( uint64_t j = ia + 1; j <= ib; ++j ) {
+			lod_bucket next;
+			read_bucket(l, k, j, &next);
+			bucket_merge(&out[i], &next);
+		}
+	}
+	return width;
+}
+
+int lod_render_raw(sct_reader* r, uint64_t t0, uint64_t t1, int width, lod_bucket* out)
+{
+	if ( t1 <= t0 || width <= 0 ) {
+		return 0;
+	}
+	sct_cursor c;
+	c.r = r;
+	c.chunk = sct_find_chunk(r, t0);
+	c.pos = 0;
+	trace_event ev;
+	uint16_t pins = 0;
+	int have = sct_cursor_next(&c, &ev);
+	if ( have ) {
+		pins = ev.pins;
+	}
+	// state at t0 is that of the last event before it
+	while ( have && ev.t < t0 ) {
+		pins = ev.pins;
+		have = sct_cursor_next(&c, &ev);
+	}
+	int i = 0;
+	bucket_start(&out[0], pins);
+	while ( have && ev.t < t1 ) {
+		int col = (ev.t - t0) * (unsigned __int128)width / (t1 - t0);
+		while ( i < col ) {
+			bucket_start(&out[++i], pins);
+		}
+		bucket_apply(&out[i], pins, ev.pins);
+		pins = ev.pins;
+		have = sct_cursor_next(&c, &ev);
+	}
+	while ( i + 1 < width ) {
+		bucket_start(&out[++i], pins);
+	}
+	return width;
+}
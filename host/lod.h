@@ -0,0 +1,67 @@
+#ifndef lod_h__
+#define lod_h__
+
+// Level-of-detail index for zooming long captures.
+//
+// Level 0 splits the trace into buckets of 2^base_shift ticks (by default
+// 2^16, one Timer1 epoch), and each further level doubles the bucket width
+// until one bucket covers the whole trace or is 2^LOD_MAX_SHIFT ticks wide.
+// A bucket records the pin state at its start, which pins were low or high
+// at any time during it, and the number of edges per channel. Rendering a view of any width picks the level
+// closest to one bucket per column, so it touches O(columns) records.
+//
+// The index is built in a single pass over a .sct file, whose header gives
+// the duration up front so every level's position in the file is known.
+//
+// Layout, all integers little-endian:
+//	header	LOD_HEADER_SIZE bytes, followed by one (offset, count) u64 pair per level
+//	levels	records of LOD_RECORD_SIZE(nchannels) bytes: first, lo, hi, 0 (u16 each),
+//			then a u32 edge count per channel
+
+#include "trace.h"
+#include "sctfile.h"
+
+#define LOD_MAGIC			"SCTLOD1"
+#define LOD_HEADER_SIZE		32
+#define LOD_MAX_LEVELS		48
+#define LOD_BASE_SHIFT		16
+#define LOD_MAX_SHIFT		63		// widest bucket, so bucket widths fit in a u64
+#define LOD_RECORD_SIZE(nch)	(8 + 4 * (nch))
+
+typedef struct lod_bucket {
+	uint16_t first;			// pins at the start of the bucket
+	uint16_t lo;			// AND of all states during the bucket
+	uint16_t hi;			// OR of all states during the bucket
+	uint32_t edges[16];		// per channel, indexed by channel number
+} lod_bucket;
+
+// Builds path from the trace open in r. Returns 0 on success.
+int lod_build(sct_reader* r, const char* path, uint8_t base_shift);
+
+typedef struct lod_index {
+	int fd;
+	const uint8_t* map;
+	size_t size;
+	char port;
+	uint32_t tick_hz;
+	uint8_t base_shift;
+	uint8_t nlevels;
+	uint8_t nchannels;
+	uint16_t mask;
+	uint64_t t0;			// start of bucket 0 of every level
+	uint64_t offset[LOD_MAX_LEVELS];
+	uint64_t count[LOD_MAX_LEVELS];
+} lod_index;
+
+int lod_open(lod_index* l, const char* path);
+void lod_close(lod_index* l);
+
+// Fills out[width] with one merged bucket per column of [t0, t1).
+// Returns 0 if the finest level is coarser than a column (the caller should
+// render from the raw trace instead), otherwise the number of columns.
+int lod_render(const lod_index* l, uint64_t t0, uint64_t t1, int width, lod_bucket* out);
+
+// The same from raw events, for zoom levels finer than the index.
+int lod_render_raw(sct_reader* r, uint64_t t0, uint64_t t1, int width, lod_bucket* out);
+
+#endif
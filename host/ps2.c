@@ -0,0 +1,187 @@
+// PS/2 (AT) keyboard protocol decoder.
+
+#include <stdio.h>
+#include <string.h>
+#include "ps2.h"
+
+// Device clock half periods are 30-50us and a host inhibit is at least
+// 100us, so split the difference...
+#define PS2_INHIBIT_US	75
+// ... and end a frame if the clock stops for far longer than a bit time.
+#define PS2_TIMEOUT_US	2000
+
+void ps2_init(ps2_decoder* d, const decoder_config* cfg, decode_frame_fn fn, void* ctx)
+{
+	memset(d, 0, sizeof(*d));
+	d->clk = 1 << cfg->clk;
+	d->dat = 1 << cfg->dat;
+	d->inhibit_ticks = (uint64_t)cfg->tick_hz * PS2_INHIBIT_US / 1000000;
+	d->timeout_ticks = (uint64_t)cfg->tick_hz * PS2_TIMEOUT_US / 1000000;
+	d->fn = fn;
+	d->ctx = ctx;
+}
+
+static void emit(ps2_decoder* d, uint8_t flags)
+{
+	decode_frame* f = &d->f;
+	uint8_t expect = (f->dir == PS2_HOST) ? 12 : 11;
+	f->value = d->shift >> 1;
+	f->flags = flags;
+	if ( f->bits == expect ) {
+		uint8_t parity = (d->shift >> 9) & 1;
+		if ( d->shift & 0x001 ) {
+			f->flags |= PS2_ERR_START;
+		}
+		if ( !((__builtin_popcount(f->value) + parity) & 1) ) {
+			f->flags |= PS2_ERR_PARITY;
+		}
+		if ( !(d->shift & 0x400) ) {
+			f->flags |= PS2_ERR_STOP;
+		}
+		if ( f->dir == PS2_HOST && (d->shift & 0x800) ) {
+			f->flags |= PS2_ERR_ACK;
+		}
+	}
+	d->fn(d->ctx, f);
+	d->active = 0;
+}
+
+static void begin(ps2_decoder* d, uint64_t t, uint8_t dir)
+{
+	memset(&d->f, 0, sizeof(d->f));
+	d->f.t = t;
+	d->f.dir = dir;
+	d->f.min_period = UINT32_MAX;
+	d->shift = 0;
+	d->active = 1;
+}
+
+void ps2_event(ps2_decoder* d, const trace_event* ev)
+{
+	if ( d->active && ev->t - d->t_fall > d->timeout_ticks ) {
+		emit(d, PS2_ERR_TIMEOUT);
+	}
+	if ( !(ev->flags & TRACE_EDGE) ) {
+		return;
+	}
+	if ( !d->have_pins ) {
+		d->have_pins = 1;
+		d->pins = ev->pins;
+		return;
+	}
+	uint16_t changed = d->pins ^ ev->pins;
+	d->pins = ev->pins;
+	if ( changed & d->dat ) {
+		if ( d->active && d->hold_pending ) {
+			uint64_t hold = ev->t - d->t_fall;
+			if ( !d->f.min_hold || hold < d->f.min_hold ) d->f.min_hold = hold;
+		}
+		d->hold_pending = 0;
+		d->t_dat = ev->t;
+	}
+	if ( !(changed & d->clk) ) {
+		return;
+	}
+	// Data changes before the clock edge in both directions, so if a
+	// snapshot caught both, the new data value is the one being clocked.
+	uint8_t data = (ev->pins & d->dat) ? 1 : 0;
+
+	if ( ev->pins & d->clk ) {
+		// rising: a long low period was the host inhibiting
+		if ( ev->t - d->t_fall >= d->inhibit_ticks ) {
+			if ( d->active ) {
+				emit(d, PS2_ERR_ABORT);
+			}
+			d->rts = !data;
+			if ( d->rts ) {
+				begin(d, ev->t, PS2_HOST);
+				d->active = 0;
+			}
+		}
+		return;
+	}
+
+	// falling: sample data
+	uint64_t prev = d->t_fall;
+	d->t_fall = ev->t;
+	if ( d->rts ) {
+		d->rts = 0;
+		d->active = 1;		// begin() was called at the request to send
+	} else if ( !d->active ) {
+		if ( data ) {
+			return;			// not a start bit
+		}
+		begin(d, ev->t, PS2_DEVICE);
+	}
+	decode_frame* f = &d->f;
+	if ( f->bits ) {
+		uint32_t period = ev->t - prev;
+		if ( period < f->min_period ) f->min_period = period;
+		if ( period > f->max_period ) f->max_period = period;
+	}
+	uint64_t setup = ev->t - d->t_dat;
+	if ( setup && (!f->min_setup || setup < f->min_setup) ) {
+		f->min_setup = setup;
+	}
+	d->hold_pending = 1;
+	d->shift |= data << f->bits;
+	f->t_end = ev->t;
+	if ( ++f->bits == ((f->dir == PS2_HOST) ? 12 : 11) ) {
+		emit(d, 0);
+	}
+}
+
+void ps2_finish(ps2_decoder* d)
+{
+	if ( d->active ) {
+		emit(d, PS2_ERR_TIMEOUT);
+	}
+}
+
+int ps2_idle(const ps2_decoder* d)
+{
+	return !d->active && !d->rts;
+}
+
+void ps2_frame_from_byte(const trace_byte* b, uint32_t tick_hz, decode_frame* f)
+{
+	uint64_t ticks_us = tick_hz / 1000000;
+	memset(f, 0, sizeof(*f));
+	f->t_end = b->t;
+	f->t = b->t - (uint64_t)b->span_us * ticks_us;
+	f->min_period = b->min_us * ticks_us;
+	f->max_period = b->max_us * ticks_us;
+	f->value = b->value;
+	f->dir = (b->flags & TRACE_BYTE_HOST) ? PS2_HOST : PS2_DEVICE;
+	f->flags = b->flags & ~TRACE_BYTE_HOST;
+	f->bits = b->bits;
+}
+
+const char* ps2_dir_str(uint8_t dir)
+{
+	return (dir == PS2_HOST) ? "host" : "device";
+}
+
+const char* ps2_flags_str(uint8_t flags, char* buf, size_t len)
+{
+	static const char* const names[] = { "start", "parity", "stop", "noack", "abort", "timeout" };
+	size_t n = 0;
+	buf[0] = 0;
+	for ( uint8_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i ) {
+		if ( flags & (1 << i) ) {
+			n += snprintf(buf + n, n < len ? len - n : 0, "%s%s", n ? "," : "", names[i]);
+		}
+	}
+	return buf;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static void ops_init(void* d, const decoder_config* cfg, decode_frame_fn fn, void* ctx) { ps2_init(d, cfg, fn, ctx); }
+static void ops_event(void* d, const trace_event* ev) { ps2_event(d, ev); }
+static void ops_finish(void* d) { ps2_finish(d); }
+static int ops_idle(const void* d) { return ps2_idle(d); }
+
+const decoder_ops ps2_decoder_ops = {
+	"ps2", sizeof(ps2_decoder), ops_init, ops_event, ops_finish, ops_idle, ps2_flags_str, ps2_dir_str
+};
@@ -0,0 +1,66 @@
+#ifndef ps2_h__
+#define ps2_h__
+
+// PS/2 (AT) keyboard protocol decoder over the edge stream.
+//
+// Data is sampled on each falling clock edge. A device-to-host frame is 11
+// clocks: start (0), 8 data bits LSB first, odd parity, stop (1). A
+// host-to-device frame starts with the host holding clock low for over
+// 100us then pulling data low (request to send); the device then clocks out
+// start, 8 data bits, parity, stop and finally its acknowledge (0), so 12
+// falling edges. Holding clock low mid-frame is the host aborting it.
+
+#include "trace.h"
+#include "decode.h"
+
+// decode_frame.dir
+#define PS2_DEVICE		0		// device to host
+#define PS2_HOST		1		// host to device
+
+// decode_frame.flags
+#define PS2_ERR_START	0x01
+#define PS2_ERR_PARITY	0x02
+#define PS2_ERR_STOP	0x04
+#define PS2_ERR_ACK		0x08	// host frame not acknowledged
+#define PS2_ERR_ABORT	0x10	// clock inhibited mid-frame
+#define PS2_ERR_TIMEOUT	0x20	// clock stopped mid-frame
+
+typedef struct ps2_decoder {
+	uint16_t clk;			// channel masks
+	uint16_t dat;
+	uint32_t inhibit_ticks;	// clock low time that means the host is inhibiting
+	uint32_t timeout_ticks;	// gap between clocks that ends a frame
+	decode_frame_fn fn;
+	void* ctx;
+
+	uint8_t have_pins;
+	uint16_t pins;
+	uint64_t t_fall;		// latest falling clock edge
+	uint64_t t_dat;			// latest data change
+	uint8_t hold_pending;	// no data change since the last sample yet
+	uint8_t active;			// in a frame
+	uint8_t rts;			// host request to send seen, frame starts at next falling edge
+	uint16_t shift;			// sampled bits, first in bit 0
+	decode_frame f;
+} ps2_decoder;
+
+extern const decoder_ops ps2_decoder_ops;
+
+void ps2_init(ps2_decoder* d, const decoder_config* cfg, decode_frame_fn fn, void* ctx);
+void ps2_event(ps2_decoder* d, const trace_event* ev);
+
+// Reports a frame still in progress at the end of the input.
+void ps2_finish(ps2_decoder* d);
+
+// Between frames, with no host request to send pending.
+int ps2_idle(const ps2_decoder* d);
+
+// The frame for a byte the device decoded itself (PS2_DECODE_ENABLE
+// firmware, see trace_byte).
+void ps2_frame_from_byte(const trace_byte* b, uint32_t tick_hz, decode_frame* f);
+
+// Formats frame flags as text, e.g. "parity,stop".
+const char* ps2_flags_str(uint8_t flags, char* buf, size_t len);
+const char* ps2_dir_str(uint8_t dir);
+
+#endif
@@ -0,0 +1,84 @@
+// Lock-free SPSC ring.
+
+#include <stdlib.h>
+#include <string.h>
+#include "ring.h"
+
+int ring_init(ring* r, size_t elem, size_t capacity)
+{
+	memset(r, 0, sizeof(*r));
+	size_t cap = 1;
+	while ( cap < capacity ) {
+		cap <<= 1;
+	}
+	r->buf = malloc(cap * elem);
+	if ( !r->buf ) {
+		return -1;
+	}
+	r->elem = elem;
+	r->mask = cap - 1;
+	return 0;
+}
+
+void ring_free(ring* r)
+{
+	free(r->buf);
+	r->buf = 0;
+}
+
+// Copies n elements between the ring at index i and p, in up to two pieces.
+static void copy(ring* r, uint64_t i, void* p, size_t n, int to_ring)
+{
+	size_t at = i & r->mask;
+	size_t first = r->mask + 1 - at;
+	if ( first > n ) {
+		first = n;
+	}
+	uint8_t* q = p;
+	if ( to_ring ) {
+		memcpy(r->buf + at * r->elem, q, first * r->elem);
+		memcpy(r->buf, q + first * r->elem, (n - first) * r->elem);
+	} else {
+		memcpy(q, r->buf + at * r->elem, first * r->elem);
+		memcpy(q + first * r->elem, r->buf, (n - first) * r->elem);
+	}
+}
+
+size_t ring_write(ring* r, const void* src, size_t n)
+{
+	uint64_t head = r->head;	// only we write it
+	uint64_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+	size_t space = r->mask + 1 - (head - tail);
+	if ( n > space ) {
+		n = space;
+	}
+	if ( !n ) {
+		return 0;
+	}
+	copy(r, head, (void*)src, n, 1);
+	__atomic_store_n(&r->head, head + n, __ATOMIC_RELEASE);
+	if ( head + n - tail > r->high ) {
+		r->high = head + n - tail;
+	}
+	return n;
+}
+
+size_t ring_read(ring* r, void* dst, size_t n)
+{
+	uint64_t tail = r->tail;	// only we write it
+	uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	if ( n > head - tail ) {
+		n = head - tail;
+	}
+	if ( !n ) {
+		return 0;
+	}
+	copy(r, tail, dst, n, 0);
+	__atomic_store_n(&r->tail, tail + n, __ATOMIC_RELEASE);
+	return n;
+}
+
+size_t ring_used(const ring* r)
+{
+	return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+}
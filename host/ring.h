@@ -0,0 +1,39 @@
+#ifndef ring_h__
+#define ring_h__
+
+// Lock-free single producer, single consumer ring of fixed size elements.
+//
+// One thread may only write and one other thread may only read. Each side
+// owns one index and reads the other's with acquire ordering, so neither
+// ever waits on the other: a full ring makes the write come up short and an
+// empty one makes the read return 0, and the caller decides what to do
+// (drop, back off, or poll again). The indices are free running 64-bit
+// counts, wrapped with a mask, so the capacity is a power of two.
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct ring {
+	uint8_t* buf;
+	size_t elem;			// element size in bytes
+	uint64_t mask;			// capacity - 1, in elements
+	// producer and consumer indices on separate cache lines
+	uint64_t head __attribute__((aligned(64)));		// next element to write
+	uint64_t high;			// most elements ever queued, updated by the producer
+	uint64_t tail __attribute__((aligned(64)));		// next element to read
+} ring;
+
+// Capacity is rounded up to a power of two. Returns 0 on success.
+int ring_init(ring* r, size_t elem, size_t capacity);
+void ring_free(ring* r);
+
+// Queues up to n elements, returns how many fit.
+size_t ring_write(ring* r, const void* src, size_t n);
+
+// Dequeues up to n elements, returns how many there were.
+size_t ring_read(ring* r, void* dst, size_t n);
+
+// Elements queued (exact only from the producer or consumer thread).
+size_t ring_used(const ring* r);
+
+#endif
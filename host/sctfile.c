@@ -0,0 +1,428 @@
+// Binary trace container: streaming writer and memory-mapped reader.
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "sctfile.h"
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// encoding helpers
+
+static void put32(uint8_t* p, uint32_t v)
+{
+	p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+static void put64(uint8_t* p, uint64_t v)
+{
+	put32(p, v);
+	put32(p + 4, v >> 32);
+}
+
+static uint32_t get32(const uint8_t* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get64(const uint8_t* p)
+{
+	return get32(p) | ((uint64_t)get32(p + 4) << 32);
+}
+
+static uint8_t* put_varint(uint8_t* p, uint64_t v)
+{
+	while ( v >= 0x80 ) {
+		*p++ = v | 0x80;
+		v >>= 7;
+	}
+	*p++ = v;
+	return p;
+}
+
+static const uint8_t* get_varint(const uint8_t* p, const uint8_t* end, uint64_t* v)
+{
+	uint64_t r = 0;
+	uint8_t shift = 0;
+	while ( p < end && shift < 64 ) {
+		uint8_t b = *p++;
+		r |= (uint64_t)(b & 0x7F) << shift;
+		if ( !(b & 0x80) ) {
+			*v = r;
+			return p;
+		}
+		shift += 7;
+	}
+	return 0;
+}
+
+static void put_header(uint8_t* h, const sct_info* info, uint64_t index_offset)
+{
+	memset(h, 0, SCT_HEADER_SIZE);
+	memcpy(h, SCT_MAGIC, 8);
+	put32(h + 8, info->tick_hz);
+	h[12] = info->port;
+	put32(h + 16, info->chunk_events);
+	put32(h + 20, info->nchunks);
+	put64(h + 24, info->nevents);
+	put64(h + 32, index_offset);
+	put64(h + 40, info->t_first);
+	put64(h + 48, info->t_last);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// writer
+
+int sct_encoder_init(sct_encoder* e)
+{
+	memset(e, 0, sizeof(*e));
+	e->buf = malloc(SCT_CHUNK_EVENTS * SCT_EVENT_MAXSZ);
+	return e->buf ? 0 : -1;
+}
+
+void sct_encoder_free(sct_encoder* e)
+{
+	free(e->buf);
+	e->buf = 0;
+}
+
+int sct_encoder_put(sct_encoder* e, const trace_event* ev)
+{
+	if ( !e->n ) {
+		e->t0 = ev->t;
+		e->prev_t = ev->t;
+		e->prev_pins = 0;
+	}
+	if ( ev->t < e->prev_t ) {
+		errno = EINVAL;
+		return -1;
+	}
+	uint8_t* p = e->buf + e->buflen;
+	p = put_varint(p, ((ev->t - e->prev_t) << 2) | (ev->flags & TRACE_FLAG_MASK));
+	p = put_varint(p, ev->pins ^ e->prev_pins);
+	e->buflen = p - e->buf;
+	e->prev_t = ev->t;
+	e->prev_pins = ev->pins;
+	++e->n;
+	return 0;
+}
+
+int sct_writer_open(sct_writer* w, const char* path, char port, uint32_t tick_hz)
+{
+	memset(w, 0, sizeof(*w));
+	w->info.tick_hz = tick_hz;
+	w->info.port = port;
+	w->info.chunk_events = SCT_CHUNK_EVENTS;
+	if ( sct_encoder_init(&w->enc) ) {
+		return -1;
+	}
+	w->f = fopen(path, "wb");
+	if ( !w->f ) {
+		sct_encoder_free(&w->enc);
+		return -1;
+	}
+	// Placeholder header, rewritten by sct_writer_close()...
+	uint8_t h[SCT_HEADER_SIZE];
+	put_header(h, &w->info, 0);
+	if ( fwrite(h, SCT_HEADER_SIZE, 1, w->f) != 1 ) {
+		fclose(w->f);
+		sct_encoder_free(&w->enc);
+		return -1;
+	}
+	w->offset = SCT_HEADER_SIZE;
+	return 0;
+}
+
+static int reserve_index(sct_writer* w)
+{
+	if ( w->info.nchunks < w->index_cap ) {
+		return 0;
+	}
+	uint32_t cap = w->index_cap ? w->index_cap * 2 : 256;
+	sct_index_entry* p = realloc(w->index, cap * sizeof(*p));
+	if ( !p ) {
+		return -1;
+	}
+	w->index = p;
+	w->index_cap = cap;
+	return 0;
+}
+
+int sct_writer_chunk(sct_writer* w, sct_encoder* e)
+{
+	if ( !e->n ) {
+		return 0;
+	}
+	if ( w->info.nchunks && e->t0 < w->prev_t ) {
+		errno = EINVAL;
+		return -1;
+	}
+	if ( reserve_index(w) ) {
+		return -1;
+	}
+	sct_index_entry* x = &w->index[w->info.nchunks++];
+	x->offset = w->offset;
+	x->t0 = e->t0;
+	x->nevents = e->n;
+	x->nbytes = e->buflen;
+	if ( fwrite(e->buf, 1, e->buflen, w->f) != e->buflen ) {
+		return -1;
+	}
+	if ( !w->info.nevents ) {
+		w->info.t_first = e->t0;
+	}
+	w->info.t_last = e->prev_t;
+	w->info.nevents += e->n;
+	w->prev_t = e->prev_t;
+	w->offset += e->buflen;
+	e->buflen = 0;
+	e->n = 0;
+	return 0;
+}
+
+int sct_writer_put(sct_writer* w, const trace_event* ev)
+{
+	if ( !w->enc.n && w->info.nchunks && ev->t < w->prev_t ) {
+		errno = EINVAL;
+		return -1;
+	}
+	if ( sct_encoder_put(&w->enc, ev) ) {
+		return -1;
+	}
+	if ( w->enc.n == w->info.chunk_events ) {
+		return sct_writer_chunk(w, &w->enc);
+	}
+	return 0;
+}
+
+int sct_writer_close(sct_writer* w)
+{
+	int rc = sct_writer_chunk(w, &w->enc);
+	uint64_t index_offset = w->offset;
+	for ( uint32_t i = 0; !rc && i < w->info.nchunks; ++i ) {
+		uint8_t e[SCT_INDEX_SIZE];
+		put64(e, w->index[i].offset);
+		put64(e + 8, w->index[i].t0);
+		put32(e + 16, w->index[i].nevents);
+		put32(e + 20, w->index[i].nbytes);
+		if ( fwrite(e, SCT_INDEX_SIZE, 1, w->f) != 1 ) {
+			rc = -1;
+		}
+	}
+	if ( !rc ) {
+		uint8_t h[SCT_HEADER_SIZE];
+		put_header(h, &w->info, index_offset);
+		if ( fseek(w->f, 0, SEEK_SET) || fwrite(h, SCT_HEADER_SIZE, 1, w->f) != 1 ) {
+			rc = -1;
+		}
+	}
+	if ( fclose(w->f) ) {
+		rc = -1;
+	}
+	free(w->index);
+	sct_encoder_free(&w->enc);
+	return rc;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// reader
+
+int sct_probe(const char* path)
+{
+	char magic[8];
+	FILE* f = fopen(path, "rb");
+	if ( !f ) {
+		return 0;
+	}
+	int ok = fread(magic, 8, 1, f) == 1 && !memcmp(magic, SCT_MAGIC, 8);
+	fclose(f);
+	return ok;
+}
+
+int sct_open(sct_reader* r, const char* path)
+{
+	memset(r, 0, sizeof(*r));
+	for ( int i = 0; i < SCT_CACHE_CHUNKS; ++i ) {
+		r->cache[i].chunk = -1;
+	}
+	r->fd = open(path, O_RDONLY);
+	if ( r->fd < 0 ) {
+		return -1;
+	}
+	struct stat st;
+	if ( fstat(r->fd, &st) ) {
+		goto fail;
+	}
+	r->size = st.st_size;
+	if ( r->size < SCT_HEADER_SIZE ) {
+		errno = EINVAL;
+		goto fail;
+	}
+	void* map = mmap(0, r->size, PROT_READ, MAP_SHARED, r->fd, 0);
+	if ( map == MAP_FAILED ) {
+		goto fail;
+	}
+	r->map = map;
+
+	const uint8_t* h = r->map;
+	uint64_t index_offset = get64(h + 32);
+	r->info.tick_hz = get32(h + 8);
+	r->info.port = h[12];
+	r->info.chunk_events = get32(h + 16);
+	r->info.nchunks = get32(h + 20);
+	r->info.nevents = get64(h + 24);
+	r->info.t_first = get64(h + 40);
+	r->info.t_last = get64(h + 48);
+	// chunk_events sizes the decode buffers, and writers use SCT_CHUNK_EVENTS
+	if ( memcmp(h, SCT_MAGIC, 8) || !r->info.tick_hz
+	  || !r->info.chunk_events || r->info.chunk_events > SCT_CHUNK_EVENTS
+	  || index_offset < SCT_HEADER_SIZE || index_offset > r->size
+	  || (r->size - index_offset) / SCT_INDEX_SIZE < r->info.nchunks ) {
+		// also catches a writer that never reached sct_writer_close()
+		munmap(map, r->size);
+		errno = EINVAL;
+		goto fail;
+	}
+	r->index = r->map + index_offset;
+	return 0;
+
+fail:
+	close(r->fd);
+	return -1;
+}
+
+void sct_close(sct_reader* r)
+{
+	for ( int i = 0; i < SCT_CACHE_CHUNKS; ++i ) {
+		free(r->cache[i].events);
+	}
+	munmap((void*)r->map, r->size);
+	close(r->fd);
+}
+
+void sct_chunk_entry(const sct_reader* r, uint32_t chunk, sct_index_entry* e)
+{
+	const uint8_t* p = r->index + (size_t)chunk * SCT_INDEX_SIZE;
+	e->offset = get64(p);
+	e->t0 = get64(p + 8);
+	e->nevents = get32(p + 16);
+	e->nbytes = get32(p + 20);
+}
+
+int sct_decode_chunk(const sct_reader* r, uint32_t chunk, trace_event* out)
+{
+	sct_index_entry e;
+	sct_chunk_entry(r, chunk, &e);
+	uint64_t index_offset = r->index - r->map;
+	if ( e.nevents > r->info.chunk_events || e.offset < SCT_HEADER_SIZE
+	  || e.offset > index_offset || e.nbytes > index_offset - e.offset ) {
+		return -1;
+	}
+	const uint8_t* p = r->map + e.offset;
+	const uint8_t* end = p + e.nbytes;
+	uint64_t t = e.t0;
+	uint16_t pins = 0;
+	for ( uint32_t i = 0; i < e.nevents; ++i ) {
+		uint64_t tf, dp;
+		if ( !(p = get_varint(p, end, &tf)) || !(p = get_varint(p, end, &dp)) ) {
+			return -1;
+		}
+		t += tf >> 2;
+		pins ^= dp;
+		out[i].t = t;
+		out[i].pins = pins;
+		out[i].flags = tf & 3;
+	}
+
+	// The decoded copy is all we need now, so let the kernel drop the
+	// chunk's pages from our resident set (they stay in the page cache).
+	long pagesz = sysconf(_SC_PAGESIZE);
+	uintptr_t lo = ((uintptr_t)(r->map + e.offset) + pagesz - 1) & ~(uintptr_t)(pagesz - 1);
+	uintptr_t hi = (uintptr_t)end & ~(uintptr_t)(pagesz - 1);
+	if ( hi > lo ) {
+		madvise((void*)lo, hi - lo, MADV_DONTNEED);
+	}
+	return e.nevents;
+}
+
+const trace_event* sct_chunk(sct_reader* r, uint32_t chunk, uint32_t* n)
+{
+	sct_cache_slot* victim = &r->cache[0];
+	for ( int i = 0; i < SCT_CACHE_CHUNKS; ++i ) {
+		sct_cache_slot* s = &r->cache[i];
+		if ( s->chunk == chunk ) {
+			s->used = ++r->clock;
+			*n = s->n;
+			return s->events;
+		}
+		if ( s->used < victim->used ) {
+			victim = s;
+		}
+	}
+	if ( chunk >= r->info.nchunks ) {
+		return 0;
+	}
+	if ( !victim->events ) {
+		victim->events = malloc(r->info.chunk_events * sizeof(trace_event));
+		if ( !victim->events ) {
+			return 0;
+		}
+	}
+	int count = sct_decode_chunk(r, chunk, victim->events);
+	if ( count < 0 ) {
+		victim->chunk = -1;
+		victim->used = 0;
+		return 0;
+	}
+	victim->chunk = chunk;
+	victim->n = count;
+	victim->used = ++r->clock;
+	*n = count;
+	return victim->events;
+}
+
+uint32_t sct_find_chunk(const sct_reader* r, uint64_t t)
+{
+	uint32_t lo = 0, hi = r->info.nchunks;
+	while ( hi - lo > 1 ) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if ( get64(r->index + (size_t)mid * SCT_INDEX_SIZE + 8) <= t ) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+void sct_cursor_seek(sct_cursor* c, sct_reader* r, uint64_t t)
+{
+	c->r = r;
+	c->chunk = sct_find_chunk(r, t);
+	c->pos = 0;
+	uint32_t n;
+	const trace_event* ev = sct_chunk(r, c->chunk, &n);
+	if ( ev ) {
+		while ( c->pos < n && ev[c->pos].t < t ) {
+			++c->pos;
+		}
+	}
+}
+
+int sct_cursor_next(sct_cursor* c, trace_event* ev)
+{
+	while ( c->chunk < c->r->info.nchunks ) {
+		uint32_t n;
+		const trace_event* events = sct_chunk(c->r, c->chunk, &n);
+		if ( events && c->pos < n ) {
+			*ev = events[c->pos++];
+			return 1;
+		}
+		++c->chunk;
+		c->pos = 0;
+	}
+	return 0;
+}
@@ -0,0 +1,136 @@
+#ifndef sctfile_h__
+#define sctfile_h__
+
+// Binary trace container (.sct).
+//
+// Layout, all integers little-endian:
+//	header	SCT_HEADER_SIZE bytes
+//	chunks	nchunks blocks of up to chunk_events delta-encoded events
+//	index	nchunks entries of SCT_INDEX_SIZE bytes
+//
+// Each event in a chunk is two varints: (dt << 2) | flags, where dt is
+// relative to the previous event (or the chunk's start time from the index),
+// then pins XORed with the previous event's pins (0 at chunk start).
+// Chunks decode independently, so readers only touch the chunks they need.
+
+#include <stdio.h>
+#include "trace.h"
+
+#define SCT_MAGIC			"SCTRACE1"
+#define SCT_HEADER_SIZE		64
+#define SCT_INDEX_SIZE		24
+#define SCT_CHUNK_EVENTS	4096
+#define SCT_EVENT_MAXSZ		13		// 10 byte time varint + 3 byte pins varint
+
+typedef struct sct_info {
+	uint32_t tick_hz;
+	char port;				// CAPTURE_PORT the trace was taken with
+	uint32_t chunk_events;
+	uint32_t nchunks;
+	uint64_t nevents;
+	uint64_t t_first;
+	uint64_t t_last;
+} sct_info;
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// writer
+
+typedef struct sct_index_entry {
+	uint64_t offset;
+	uint64_t t0;
+	uint32_t nevents;
+	uint32_t nbytes;
+} sct_index_entry;
+
+// One chunk being encoded. Encoding is separate from writing so the two can
+// run on different threads.
+typedef struct sct_encoder {
+	uint8_t* buf;			// SCT_CHUNK_EVENTS * SCT_EVENT_MAXSZ bytes
+	uint32_t buflen;
+	uint32_t n;				// events encoded, SCT_CHUNK_EVENTS when full
+	uint64_t t0;
+	uint64_t prev_t;
+	uint16_t prev_pins;
+} sct_encoder;
+
+int sct_encoder_init(sct_encoder* e);
+void sct_encoder_free(sct_encoder* e);
+
+// Appends an event to a chunk that isn't full. Fails if time goes backwards.
+int sct_encoder_put(sct_encoder* e, const trace_event* ev);
+
+typedef struct sct_writer {
+	FILE* f;
+	sct_info info;
+	uint64_t offset;
+	sct_index_entry* index;
+	uint32_t index_cap;
+	uint64_t prev_t;		// end of the previous chunk
+	sct_encoder enc;		// for sct_writer_put
+} sct_writer;
+
+int sct_writer_open(sct_writer* w, const char* path, char port, uint32_t tick_hz);
+int sct_writer_put(sct_writer* w, const trace_event* ev);
+
+// Writes a chunk encoded elsewhere and empties e for reuse. Must not be mixed
+// with sct_writer_put.
+int sct_writer_chunk(sct_writer* w, sct_encoder* e);
+
+int sct_writer_close(sct_writer* w);
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// reader
+
+// Number of decoded chunks kept by a reader.
+#define SCT_CACHE_CHUNKS	8
+
+typedef struct sct_cache_slot {
+	int64_t chunk;			// -1 if unused
+	uint64_t used;			// LRU stamp
+	trace_event* events;
+	uint32_t n;
+} sct_cache_slot;
+
+typedef struct sct_reader {
+	int fd;
+	const uint8_t* map;
+	size_t size;
+	sct_info info;
+	const uint8_t* index;	// points into map
+	uint64_t clock;
+	sct_cache_slot cache[SCT_CACHE_CHUNKS];
+} sct_reader;
+
+// Returns 1 if the file starts with SCT_MAGIC.
+int sct_probe(const char* path);
+
+int sct_open(sct_reader* r, const char* path);
+void sct_close(sct_reader* r);
+
+void sct_chunk_entry(const sct_reader* r, uint32_t chunk, sct_index_entry* e);
+
+// Decodes a chunk into out[info.chunk_events] without touching the cache,
+// so it may be called concurrently. Returns the event count, or -1 if the
+// chunk is corrupt.
+int sct_decode_chunk(const sct_reader* r, uint32_t chunk, trace_event* out);
+
+// Decoded chunk via the cache. The pointer stays valid until
+// SCT_CACHE_CHUNKS further lookups of other chunks.
+const trace_event* sct_chunk(sct_reader* r, uint32_t chunk, uint32_t* n);
+
+// Index of the chunk containing time t (the first chunk if t is earlier).
+uint32_t sct_find_chunk(const sct_reader* r, uint64_t t);
+
+typedef struct sct_cursor {
+	sct_reader* r;
+	uint32_t chunk;
+	uint32_t pos;
+} sct_cursor;
+
+// Positions the cursor at the first event at or after time t.
+void sct_cursor_seek(sct_cursor* c, sct_reader* r, uint64_t t);
+
+// Returns 0 at the end of the trace.
+int sct_cursor_next(sct_cursor* c, trace_event* ev);
+
+#endif
@@ -0,0 +1,1085 @@
+// sctool - host-side companion for sctrace.
+//
+// Reads either raw device output (as captured by hid_listen, "-" for stdin)
+// or a binary .sct container, and runs one of the commands below over the
+// event stream. For device output, -p gives the firmware's CAPTURE_PORT
+// (D, the default, B or X) so that channels get the right names.
+//
+//	sctool import [-p port] [-r hz] in.txt out.sct	convert device output to .sct
+//	sctool dump [-p port] [-s us] [-e us] in		print events as text
+//	sctool capture [-p port] [-r hz] [-b ring_mb] [src] out.sct
+//												capture from the sctrace HID device (or src, a
+//												hidraw node, tty, file or "-") until interrupted;
+//												src "replay[@bytes_per_s]:file" replays device
+//												output or a .sct file instead (see source.h)
+//	sctool cmd [-D dev] text					send a command to the device, e.g. S (stats
+//												line now), P (profile line, PROFILE_ENABLE builds),
+//												W (stack watermark line) or Mhh (port B pins to
+//												watch, in hex)
+//	sctool info in.sct							print container header
+//	sctool vcd [-p port] in out.vcd				export Value Change Dump ("-" for stdout)
+//	sctool sr [-p port] [-S hz] in out.sr		export sigrok session (default 1 MHz samples)
+//	sctool lod [-b shift] in.sct [out.lod]		build zoom index (default in.sct.lod)
+//	sctool view [-s us] [-e us] [-w cols] in.sct	draw the waveform, using in.sct.lod if present
+//	sctool decode [-P proto] [-c clk] [-d data] [-R rst] [-n] [-j threads] [-o overlap_ms] in
+//												decode a protocol (default ps2, clock 0, data 1);
+//												.sct input is split across threads. -R names a
+//												captured reset line, -n says the keyboard wasn't
+//												reset by sctrace just before the capture began
+//	sctool ps2 [options] in						same as decode -P ps2, and reads the bytes from
+//												PS2_DECODE_ENABLE firmware
+//	sctool xt [options] in						same as decode -P xt
+//	sctool timing [-c clk] [-d data] [-m max_us] [-v] [-J] in
+//												pulse width and setup/hold statistics (-v adds
+//												histograms, -J prints JSON instead)
+//	sctool gen [-P ps2|xt] [-c clk] [-d data] [-C clock_hz] [-K keys_per_s] [-H cmds_per_s]
+//		[-g glitches_per_s] [-w glitch_us] [-J jitter_us] [-S seed] [-n events] [-e us]
+//		[-f txt|sct|vcd] out					synthesize keyboard traffic (see gen.h) as device
+//												output, .sct or VCD ("-" for stdout), for 10s
+//												unless -n or -e say otherwise
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include "trace.h"
+#include "sctfile.h"
+#include "export.h"
+#include "lod.h"
+#include "decode.h"
+#include "ps2.h"
+#include "timing.h"
+#include "capture.h"
+#include "source.h"
+#include "gen.h"
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// common options and input
+
+typedef struct options {
+	char port;
+	uint32_t tick_hz;
+	uint64_t t_start;		// ticks, only honoured by .sct input
+	uint64_t t_end;
+	trace_byte_fn byte_fn;	// for device decoded bytes in device output
+	void* byte_ctx;
+} options;
+
+static void options_init(options* o)
+{
+	o->port = 'D';
+	o->tick_hz = TRACE_TICK_HZ;
+	o->t_start = 0;
+	o->t_end = UINT64_MAX;
+	o->byte_fn = 0;
+	o->byte_ctx = 0;
+}
+
+static uint64_t us_to_ticks(const options* o, const char* s)
+{
+	return (uint64_t)(strtod(s, 0) * o->tick_hz / 1e6);
+}
+
+// Handles the options shared by all commands, returns 0 if c isn't one.
+static int common_option(options* o, int c, const char* arg)
+{
+	switch ( c ) {
+	case 'p':
+		o->port = arg[0];
+		if ( o->port != 'D' && o->port != 'B' && o->port != 'X' ) {
+			fprintf(stderr, "sctool: invalid capture port '%s'\n", arg);
+			exit(2);
+		}
+		return 1;
+	case 'r':
+		o->tick_hz = strtoul(arg, 0, 0);
+		if ( !o->tick_hz ) {
+			fprintf(stderr, "sctool: invalid tick rate '%s'\n", arg);
+			exit(2);
+		}
+		return 1;
+	case 's':
+		o->t_start = us_to_ticks(o, arg);
+		return 1;
+	case 'e':
+		o->t_end = us_to_ticks(o, arg);
+		return 1;
+	}
+	return 0;
+}
+
+static void parse_options(options* o, int argc, char** argv, const char* extra,
+	int (*fn)(void* ctx, int c, const char* arg), void* ctx)
+{
+	char optstring[64] = "p:r:s:e:";
+	strcat(optstring, extra);
+	int c;
+	optind = 1;
+	while ( (c = getopt(argc, argv, optstring)) != -1 ) {
+		if ( common_option(o, c, optarg) ) {
+			continue;
+		}
+		if ( c == '?' || !fn || !fn(ctx, c, optarg) ) {
+			exit(2);
+		}
+	}
+}
+
+// Runs fn over every event of a .sct file or device output text. For .sct
+// input the port and tick rate stored in the file override the options.
+static int run_input(const char* path, options* o, trace_event_fn fn, void* ctx)
+{
+	if ( strcmp(path, "-") && sct_probe(path) ) {
+		sct_reader r;
+		if ( sct_open(&r, path) ) {
+			fprintf(stderr, "sctool: %s: %s\n", path, strerror(errno));
+			return -1;
+		}
+		o->port = r.info.port;
+		o->tick_hz = r.info.tick_hz;
+		sct_cursor c;
+		trace_event ev;
+		sct_cursor_seek(&c, &r, o->t_start);
+		while ( sct_cursor_next(&c, &ev) && ev.t <= o->t_end ) {
+			fn(ctx, &ev);
+		}
+		sct_close(&r);
+		return 0;
+	}
+
+	// Raw device output may be a live capture piped in, so take whatever is
+	// available and flush outputs after each read to keep viewers current.
+	int fd = strcmp(path, "-") ? open(path, O_RDONLY) : 0;
+	if ( fd < 0 ) {
+		fprintf(stderr, "sctool: %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	trace_parser p;
+	trace_parser_init(&p, fn, ctx);
+	trace_parser_on_byte(&p, o->byte_fn, o->byte_ctx);
+	static char buf[65536];
+	ssize_t n;
+	while ( (n = read(fd, buf, sizeof(buf))) > 0 || (n < 0 && errno == EINTR) ) {
+		if ( n > 0 ) {
+			trace_parser_feed(&p, buf, n);
+			fflush(0);
+		}
+	}
+	trace_parser_finish(&p);
+	if ( fd ) {
+		close(fd);
+	}
+	return n < 0 ? -1 : 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// import
+
+typedef struct import_ctx {
+	sct_writer w;
+	int failed;
+} import_ctx;
+
+static void import_event(void* ctx, const trace_event* ev)
+{
+	import_ctx* ic = ctx;
+	if ( !ic->failed && sct_writer_put(&ic->w, ev) ) {
+		ic->failed = errno ? errno : EIO;
+	}
+}
+
+static int cmd_import(int argc, char** argv)
+{
+	options o;
+	options_init(&o);
+	parse_options(&o, argc, argv, "", 0, 0);
+	if ( argc - optind != 2 ) {
+		fprintf(stderr, "usage: sctool import [-p port] [-r hz] in.txt out.sct\n");
+		return 2;
+	}
+	import_ctx ic = { .failed = 0 };
+	if ( sct_writer_open(&ic.w, argv[optind + 1], o.port, o.tick_hz) ) {
+		fprintf(stderr, "sctool: %s: %s\n", argv[optind + 1], strerror(errno));
+		return 1;
+	}
+	int rc = run_input(argv[optind], &o, import_event, &ic);
+	if ( sct_writer_close(&ic.w) && !ic.failed ) {
+		ic.failed = errno ? errno : EIO;
+	}
+	if ( ic.failed ) {
+		fprintf(stderr, "sctool: %s: %s\n", argv[optind + 1], strerror(ic.failed));
+		return 1;
+	}
+	return rc ? 1 : 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// capture
+
+static int capture_option(void* ctx, int c, const char* arg)
+{
+	capture_config* cfg = ctx;
+	if ( c == 'b' ) {
+		cfg->ring_bytes = strtoul(arg, 0, 0) << 20;
+		return cfg->ring_bytes != 0;
+	}
+	return 0;
+}
+
+static void capture_signal(int sig)
+{
+	capture_stop();
+}
+
+static int cmd_capture(int argc, char** argv)
+{
+	options o;
+	options_init(&o);
+	capture_config cfg;
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.ring_bytes = 64 << 20;
+	parse_options(&o, argc, argv, "b:", capture_option, &cfg);
+	if ( argc - optind != 1 && argc - optind != 2 ) {
+		fprintf(stderr, "usage: sctool capture [-p port] [-r hz] [-b ring_mb] [src] out.sct\n");
+		return 2;
+	}
+	cfg.source = (argc - optind == 2) ? argv[optind++] : SOURCE_HID;
+	cfg.out = argv[optind];
+	cfg.port = o.port;
+	cfg.tick_hz = o.tick_hz;
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = capture_signal;
+	sigaction(SIGINT, &sa, 0);
+	sigaction(SIGTERM, &sa, 0);
+
+	capture_stats st;
+	int rc = capture_run(&cfg, &st);
+	if ( rc ) {
+		fprintf(stderr, "sctool: capture: %s\n", strerror(errno));
+	}
+	fprintf(stderr, "%llu bytes read, %llu dropped (ring high water %llu of %zu)\n",
+		(unsigned long long)st.bytes, (unsigned long long)st.dropped,
+		(unsigned long long)st.ring_high, cfg.ring_bytes);
+	fprintf(stderr, "%llu events, %llu other tokens, %llu chunks written\n",
+		(unsigned long long)st.tokens, (unsigned long long)st.skipped, (unsigned long long)st.chunks);
+	if ( st.ps2_bytes ) {
+		fprintf(stderr, "%llu device decoded PS/2 bytes written to %s%s\n",
+			(unsigned long long)st.ps2_bytes, cfg.out, CAPTURE_PS2_SUFFIX);
+	}
+	if ( st.backwards ) {
+		fprintf(stderr, "%llu events went back in time and were left out\n", (unsigned long long)st.backwards);
+	}
+	return rc ? 1 : 0;
+}
+
+static int cmd_cmd(int argc, char** argv)
+{
+	const char* dev = SOURCE_HID;
+	int c;
+	optind = 1;
+	while ( (c = getopt(argc, argv, "D:")) != -1 ) {
+		if ( c != 'D' ) {
+			return 2;
+		}
+		dev = optarg;
+	}
+	if ( argc - optind != 1 ) {
+		fprintf(stderr, "usage: sctool cmd [-D dev] text\n");
+		return 2;
+	}
+	if ( source_command(dev, argv[optind]) ) {
+		fprintf(stderr, "sctool: %s: %s\n", dev, strerror(errno));
+		return 1;
+	}
+	return 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// dump
+
+static void dump_event(void* ctx, const trace_event* ev)
+{
+	const options* o = ctx;
+	printf("%14.3f %04X %c\n", ev->t * 1e6 / o->tick_hz, ev->pins,
+		(ev->flags & TRACE_PCINT) ? 'P' : (ev->flags & TRACE_EDGE) ? 'E' : 'T');
+}
+
+static int cmd_dump(int argc, char** argv)
+{
+	options o;
+	options_init(&o);
+	parse_options(&o, argc, argv, "", 0, 0);
+	if ( argc - optind != 1 ) {
+		fprintf(stderr, "usage: sctool dump [-p port] [-s us] [-e us] in\n");
+		return 2;
+	}
+	return run_input(argv[optind], &o, dump_event, &o) ? 1 : 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// info
+
+static int cmd_info(int argc, char** argv)
+{
+	if ( argc != 2 ) {
+		fprintf(stderr, "usage: sctool info in.sct\n");
+		return 2;
+	}
+	sct_reader r;
+	if ( sct_open(&r, argv[1]) ) {
+		fprintf(stderr, "sctool: %s: %s\n", argv[1], strerror(errno));
+		return 1;
+	}
+	printf("capture port  %c\n", r.info.port);
+	printf("tick rate     %u Hz\n", r.info.tick_hz);
+	printf("events        %llu\n", (unsigned long long)r.info.nevents);
+	printf("chunks        %u x %u events\n", r.info.nchunks, r.info.chunk_events);
+	printf("duration      %.6f s\n", (r.info.t_last - r.info.t_first) / (double)r.info.tick_hz);
+	sct_close(&r);
+	return 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// vcd / sr
+
+typedef struct export_ctx {
+	vcd_writer vcd;
+	sr_writer sr;
+	uint32_t samplerate;
+	int failed;
+} export_ctx;
+
+static void vcd_export_event(void* ctx, const trace_event* ev)
+{
+	export_ctx* x = ctx;
+	if ( !x->failed && vcd_event(&x->vcd, ev) ) {
+		x->failed = errno ? errno : EIO;
+	}
+}
+
+static void sr_export_event(void* ctx, const trace_event* ev)
+{
+	export_ctx* x = ctx;
+	if ( !x->failed && sr_event(&x->sr, ev) ) {
+		x->failed = errno ? errno : EIO;
+	}
+}
+
+// .sct input knows its own port, so peek at the header before writing ours.
+static void probe_input(const char* path, options* o)
+{
+	sct_reader r;
+	if ( strcmp(path, "-") && sct_probe(path) && !sct_open(&r, path) ) {
+		o->port = r.info.port;
+		o->tick_hz = r.info.tick_hz;
+		sct_close(&r);
+	}
+}
+
+static int cmd_vcd(int argc, char** argv)
+{
+	options o;
+	options_init(&o);
+	parse_options(&o, argc, argv, "", 0, 0);
+	if ( argc - optind != 2 ) {
+		fprintf(stderr, "usage: sctool vcd [-p port] in out.vcd\n");
+		return 2;
+	}
+	const char* out = argv[optind + 1];
+	probe_input(argv[optind], &o);
+	FILE* f = strcmp(out, "-") ? fopen(out, "w") : stdout;
+	if ( !f ) {
+		fprintf(stderr, "sctool: %s: %s\n", out, strerror(errno));
+		return 1;
+	}
+	export_ctx x = { .failed = 0 };
+	vcd_begin(&x.vcd, f, o.port, o.tick_hz);
+	int rc = run_input(argv[optind], &o, vcd_export_event, &x);
+	if ( vcd_end(&x.vcd) && !x.failed ) {
+		x.failed = errno ? errno : EIO;
+	}
+	if ( f != stdout ) {
+		fclose(f);
+	}
+	if ( x.failed ) {
+		fprintf(stderr, "sctool: %s: %s\n", out, strerror(x.failed));
+		return 1;
+	}
+	return rc ? 1 : 0;
+}
+
+static int sr_option(void* ctx, int c, const char* arg)
+{
+	export_ctx* x = ctx;
+	if ( c == 'S' ) {
+		x->samplerate = strtoul(arg, 0, 0);
+		return x->samplerate != 0;
+	}
+	return 0;
+}
+
+static int cmd_sr(int argc, char** argv)
+{
+	options o;
+	options_init(&o);
+	export_ctx x = { .samplerate = 1000000, .failed = 0 };
+	parse_options(&o, argc, argv, "S:", sr_option, &x);
+	if ( argc - optind != 2 ) {
+		fprintf(stderr, "usage: sctool sr [-p port] [-S hz] in out.sr\n");
+		return 2;
+	}
+	const char* out = argv[optind + 1];
+	probe_input(argv[optind], &o);
+	if ( sr_begin(&x.sr, out, o.port, o.tick_hz, x.samplerate) ) {
+		fprintf(stderr, "sctool: %s: %s\n", out, strerror(errno));
+		return 1;
+	}
+	int rc = run_input(argv[optind], &o, sr_export_event, &x);
+	if ( sr_end(&x.sr) && !x.failed ) {
+		x.failed = errno ? errno : EIO;
+	}
+	if ( x.failed ) {
+		fprintf(stderr, "sctool: %s: %s\n", out, strerror(x.failed));
+		return 1;
+	}
+	return rc ? 1 : 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// lod / view
+
+static int lod_option(void* ctx, int c, const char* arg)
+{
+	uint8_t* base_shift = ctx;
+	if ( c == 'b' ) {
+		unsigned long v = strtoul(arg, 0, 0);
+		*base_shift = v;
+		return v <= LOD_MAX_SHIFT;
+	}
+	return 0;
+}
+
+static int cmd_lod(int argc, char** argv)
+{
+	options o;
+	options_init(&o);
+	uint8_t base_shift = LOD_BASE_SHIFT;
+	parse_options(&o, argc, argv, "b:", lod_option, &base_shift);
+	if ( argc - optind < 1 || argc - optind > 2 ) {
+		fprintf(stderr, "usage: sctool lod [-b shift] in.sct [out.lod]\n");
+		return 2;
+	}
+	const char* in = argv[optind];
+	char out[4096];
+	snprintf(out, sizeof(out), "%s.lod", in);
+	if ( argc - optind == 2 ) {
+		snprintf(out, sizeof(out), "%s", argv[optind + 1]);
+	}
+	sct_reader r;
+	if ( sct_open(&r, in) ) {
+		fprintf(stderr, "sctool: %s: %s\n", in, strerror(errno));
+		return 1;
+	}
+	int rc = lod_build(&r, out, base_shift);
+	if ( rc ) {
+		fprintf(stderr, "sctool: %s: %s\n", out, strerror(errno));
+	}
+	sct_close(&r);
+	return rc ? 1 : 0;
+}
+
+static char view_char(const lod_bucket* b, uint8_t n)
+{
+	uint16_t bit = 1 << n;
+	if ( !b->edges[n] ) {
+		return (b->first & bit) ? '-' : '_';
+	}
+	if ( b->edges[n] == 1 ) {
+		return (b->first & bit) ? '\\' : '/';
+	}
+	return 'X';
+}
+
+static int view_option(void* ctx, int c, const char* arg)
+{
+	int* width = ctx;
+	if ( c == 'w' ) {
+		*width = atoi(arg);
+		return *width > 0;
+	}
+	return 0;
+}
+
+static int cmd_view(int argc, char** argv)
+{
+	options o;
+	options_init(&o);
+	int width = 100;
+	parse_options(&o, argc, argv, "w:", view_option, &width);
+	if ( argc - optind != 1 ) {
+		fprintf(stderr, "usage: sctool view [-s us] [-e us] [-w cols] in.sct\n");
+		return 2;
+	}
+	const char* in = argv[optind];
+	sct_reader r;
+	if ( sct_open(&r, in) ) {
+		fprintf(stderr, "sctool: %s: %s\n", in, strerror(errno));
+		return 1;
+	}
+	// -s/-e are relative to the start of the trace here
+	uint64_t t0 = r.info.t_first + o.t_start;
+	uint64_t t1 = (o.t_end == UINT64_MAX) ? r.info.t_last + 1 : r.info.t_first + o.t_end;
+	lod_bucket* cols = malloc(width * sizeof(lod_bucket));
+	if ( !cols ) {
+		sct_close(&r);
+		return 1;
+	}
+	char path[4096];
+	snprintf(path, sizeof(path), "%s.lod", in);
+	lod_index l;
+	int rendered = 0;
+	if ( !lod_open(&l, path) ) {
+		rendered = lod_render(&l, t0, t1, width, cols);
+		lod_close(&l);
+	}
+	if ( !rendered ) {
+		lod_render_raw(&r, t0, t1, width, cols);
+	}
+	printf("%.3f .. %.3f ms, %.3f us per column%s\n", (t0 - r.info.t_first) * 1e3 / r.info.tick_hz,
+		(t1 - r.info.t_first) * 1e3 / r.info.tick_hz, (t1 - t0) * 1e6 / r.info.tick_hz / width,
+		rendered ? "" : " (raw)");
+	uint16_t mask = trace_channel_mask(r.info.port);
+	for ( uint8_t n = 0; n < 16; ++n ) {
+		if ( mask & (1 << n) ) {
+			printf("%-5s ", trace_channel_name(r.info.port, n));
+			for ( int i = 0; i < width; ++i ) {
+				putchar(view_char(&cols[i], n));
+			}
+			putchar('\n');
+		}
+	}
+	free(cols);
+	sct_close(&r);
+	return 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// decode
+
+typedef struct decode_opts {
+	const decoder_ops* ops;
+	decoder_config cfg;
+	unsigned threads;
+	double overlap_ms;
+	int no_reset;
+	const options* o;
+	void* state;			// serial decoder for text input
+	int started;			// state initialised, at the first event
+} decode_opts;
+
+static int decode_option(void* ctx, int c, const char* arg)
+{
+	decode_opts* dopt = ctx;
+	switch ( c ) {
+	case 'P':
+		dopt->ops = decoder_find(arg);
+		if ( !dopt->ops ) {
+			fprintf(stderr, "sctool: unknown protocol '%s'\n", arg);
+		}
+		return dopt->ops != 0;
+	case 'c':
+		dopt->cfg.clk = strtoul(arg, 0, 0);
+		return dopt->cfg.clk < 16;
+	case 'd':
+		dopt->cfg.dat = strtoul(arg, 0, 0);
+		return dopt->cfg.dat < 16;
+	case 'R':
+		dopt->cfg.rst = strtoul(arg, 0, 0);
+		return dopt->cfg.rst < 16;
+	case 'n':
+		dopt->no_reset = 1;
+		return 1;
+	case 'j':
+		dopt->threads = strtoul(arg, 0, 0);
+		return 1;
+	case 'o':
+		dopt->overlap_ms = strtod(arg, 0);
+		return dopt->overlap_ms >= 0;
+	}
+	return 0;
+}
+
+static void decode_print(void* ctx, const decode_frame* f)
+{
+	const decode_opts* dopt = ctx;
+	decode_frame_print(stdout, dopt->ops, dopt->o->tick_hz, f);
+}
+
+// A byte the device decoded itself (PS2_DECODE_ENABLE firmware).
+static void decode_byte(void* ctx, const trace_byte* b)
+{
+	const decode_opts* dopt = ctx;
+	decode_frame f;
+	ps2_frame_from_byte(b, dopt->o->tick_hz, &f);
+	decode_print(ctx, &f);
+}
+
+static void decode_feed(void* ctx, const trace_event* ev)
+{
+	decode_opts* dopt = ctx;
+	if ( !dopt->started ) {
+		// text has no header with the start time, so wait for the first event
+		if ( !dopt->no_reset ) {
+			dopt->cfg.t_reset = ev->t;
+		}
+		dopt->ops->init(dopt->state, &dopt->cfg, decode_print, dopt);
+		dopt->started = 1;
+	}
+	dopt->ops->event(dopt->state, ev);
+}
+
+static int run_decoder(int argc, char** argv, const char* proto)
+{
+	options o;
+	options_init(&o);
+	decode_opts dopt;
+	memset(&dopt, 0, sizeof(dopt));
+	dopt.ops = proto ? decoder_find(proto) : decoder_find("ps2");
+	dopt.cfg.clk = 0;
+	dopt.cfg.dat = 1;
+	dopt.cfg.rst = DECODE_NO_CHANNEL;
+	dopt.threads = sysconf(_SC_NPROCESSORS_ONLN);
+	dopt.overlap_ms = 50;
+	dopt.o = &o;
+	parse_options(&o, argc, argv, proto ? "c:d:R:nj:o:" : "P:c:d:R:nj:o:", decode_option, &dopt);
+	if ( argc - optind != 1 ) {
+		fprintf(stderr, "usage: sctool %s [-c clk] [-d data] [-R rst] [-n] [-j threads] [-o overlap_ms] in\n",
+			proto ? proto : "decode [-P protocol]");
+		return 2;
+	}
+	const char* in = argv[optind];
+	probe_input(in, &o);
+	dopt.cfg.tick_hz = o.tick_hz;
+	// sctrace pulses -reset as it starts up, just before the first event,
+	// so unless -n is given t_reset becomes the first event's time
+	dopt.cfg.t_reset = UINT64_MAX;
+
+	if ( strcmp(in, "-") && sct_probe(in) ) {
+		sct_reader r;
+		if ( sct_open(&r, in) ) {
+			fprintf(stderr, "sctool: %s: %s\n", in, strerror(errno));
+			return 1;
+		}
+		if ( !dopt.no_reset ) {
+			dopt.cfg.t_reset = r.info.t_first;
+		}
+		int rc = decode_parallel(&r, dopt.ops, &dopt.cfg, dopt.threads,
+			(uint64_t)(dopt.overlap_ms * o.tick_hz / 1000), decode_print, &dopt);
+		if ( rc ) {
+			fprintf(stderr, "sctool: %s: %s\n", in, strerror(errno));
+		}
+		sct_close(&r);
+		return rc ? 1 : 0;
+	}
+
+	dopt.state = malloc(dopt.ops->size);
+	if ( !dopt.state ) {
+		return 1;
+	}
+	if ( dopt.ops == &ps2_decoder_ops ) {
+		o.byte_fn = decode_byte;
+		o.byte_ctx = &dopt;
+	}
+	int rc = run_input(in, &o, decode_feed, &dopt);
+	if ( dopt.started ) {
+		dopt.ops->finish(dopt.state);
+	}
+	free(dopt.state);
+	return rc ? 1 : 0;
+}
+
+static int cmd_decode(int argc, char** argv)
+{
+	return run_decoder(argc, argv, 0);
+}
+
+static int cmd_ps2(int argc, char** argv)
+{
+	return run_decoder(argc, argv, "ps2");
+}
+
+static int cmd_xt(int argc, char** argv)
+{
+	return run_decoder(argc, argv, "xt");
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// timing
+
+typedef struct timing_opts {
+	uint8_t clk;
+	uint8_t dat;
+	double max_us;
+	int verbose;
+	int json;
+} timing_opts;
+
+static int timing_option(void* ctx, int c, const char* arg)
+{
+	timing_opts* t = ctx;
+	switch ( c ) {
+	case 'c':
+		t->clk = strtoul(arg, 0, 0);
+		return t->clk < 16;
+	case 'd':
+		t->dat = strtoul(arg, 0, 0);
+		return t->dat < 16;
+	case 'm':
+		t->max_us = strtod(arg, 0);
+		return t->max_us > 0;
+	case 'v':
+		t->verbose = 1;
+		return 1;
+	case 'J':
+		t->json = 1;
+		return 1;
+	}
+	return 0;
+}
+
+static void timing_feed(void* ctx, const trace_event* ev)
+{
+	timing_event(ctx, ev);
+}
+
+static void hist_report(const char* name, const char* what, const hist* h, double us)
+{
+	printf("%-6s %-6s %10llu", name, what, (unsigned long long)h->count);
+	if ( h->count ) {
+		printf(" %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f", h->min * us, hist_percentile(h, 1) * us,
+			hist_percentile(h, 50) * us, hist_percentile(h, 99) * us, h->max * us,
+			(double)h->sum / h->count * us);
+	} else {
+		printf(" %9s %9s %9s %9s %9s %9s", "-", "-", "-", "-", "-", "-");
+	}
+	printf(" %8llu\n", (unsigned long long)h->idle);
+}
+
+static void hist_bars(const char* name, const char* what, const hist* h, double us)
+{
+	uint64_t peak = 0;
+	for ( unsigned i = 0; i < HIST_BUCKETS; ++i ) {
+		if ( h->bucket[i] > peak ) peak = h->bucket[i];
+	}
+	if ( !peak ) {
+		return;
+	}
+	printf("\n%s %s\n", name, what);
+	for ( unsigned i = 0; i < HIST_BUCKETS; ++i ) {
+		if ( h->bucket[i] ) {
+			int len = (int)(h->bucket[i] * 50 / peak);
+			printf("  %10.2f-%-10.2f %10llu %.*s\n", hist_bucket_lo(i) * us, (hist_bucket_hi(i) + 1) * us,
+				(unsigned long long)h->bucket[i], len ? len : 1,
+				"##################################################");
+		}
+	}
+}
+
+static void hist_json(const char* key, const hist* h, double us)
+{
+	printf("\"%s\":{\"count\":%llu,\"idle\":%llu", key, (unsigned long long)h->count,
+		(unsigned long long)h->idle);
+	if ( h->count ) {
+		printf(",\"min\":%.3f,\"p1\":%.3f,\"p50\":%.3f,\"p99\":%.3f,\"max\":%.3f,\"mean\":%.3f",
+			h->min * us, hist_percentile(h, 1) * us, hist_percentile(h, 50) * us,
+			hist_percentile(h, 99) * us, h->max * us, (double)h->sum / h->count * us);
+	}
+	putchar('}');
+}
+
+static int cmd_timing(int argc, char** argv)
+{
+	options o;
+	options_init(&o);
+	timing_opts t = { 0, 1, 1000, 0, 0 };
+	parse_options(&o, argc, argv, "c:d:m:vJ", timing_option, &t);
+	if ( argc - optind != 1 ) {
+		fprintf(stderr, "usage: sctool timing [-c clk] [-d data] [-m max_us] [-v] [-J] in\n");
+		return 2;
+	}
+	const char* in = argv[optind];
+	probe_input(in, &o);
+	uint16_t mask = trace_channel_mask(o.port);
+	if ( !(mask & (1 << t.clk)) || !(mask & (1 << t.dat)) ) {
+		fprintf(stderr, "sctool: port %c has no channel %u\n", o.port, (mask & (1 << t.clk)) ? t.dat : t.clk);
+		return 2;
+	}
+	timing* tm = malloc(sizeof(timing));
+	if ( !tm ) {
+		return 1;
+	}
+	timing_init(tm, mask, t.clk, t.dat, (uint64_t)(t.max_us * o.tick_hz / 1e6));
+	if ( run_input(in, &o, timing_feed, tm) ) {
+		free(tm);
+		return 1;
+	}
+
+	double us = 1e6 / o.tick_hz;
+	const char* clk = trace_channel_name(o.port, t.clk);
+	const char* dat = trace_channel_name(o.port, t.dat);
+	if ( t.json ) {
+		printf("{\"port\":\"%c\",\"tick_hz\":%u,\"max_us\":%g,\"channels\":{", o.port, o.tick_hz, t.max_us);
+		int first = 1;
+		for ( int c = 0; c < 16; ++c ) {
+			if ( mask & (1 << c) ) {
+				printf("%s\"%s\":{", first ? "" : ",", trace_channel_name(o.port, c));
+				hist_json("high", &tm->high[c], us);
+				putchar(',');
+				hist_json("low", &tm->low[c], us);
+				putchar('}');
+				first = 0;
+			}
+		}
+		printf("},\"clock\":\"%s\",\"data\":\"%s\",", clk, dat);
+		hist_json("setup", &tm->setup, us);
+		putchar(',');
+		hist_json("hold", &tm->hold, us);
+		printf("}\n");
+		free(tm);
+		return 0;
+	}
+
+	printf("%-13s %10s %9s %9s %9s %9s %9s %9s %8s\n", "times in us", "count",
+		"min", "p1", "p50", "p99", "max", "mean", "idle");
+	for ( int c = 0; c < 16; ++c ) {
+		if ( mask & (1 << c) ) {
+			hist_report(trace_channel_name(o.port, c), "high", &tm->high[c], us);
+			hist_report("", "low", &tm->low[c], us);
+		}
+	}
+	printf("%s falling edge, %s:\n", clk, dat);
+	hist_report("", "setup", &tm->setup, us);
+	hist_report("", "hold", &tm->hold, us);
+	if ( t.verbose ) {
+		for ( int c = 0; c < 16; ++c ) {
+			if ( mask & (1 << c) ) {
+				hist_bars(trace_channel_name(o.port, c), "high", &tm->high[c], us);
+				hist_bars(trace_channel_name(o.port, c), "low", &tm->low[c], us);
+			}
+		}
+		hist_bars(dat, "setup", &tm->setup, us);
+		hist_bars(dat, "hold", &tm->hold, us);
+	}
+	free(tm);
+	return 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// gen
+
+typedef struct gen_opts {
+	gen_config cfg;
+	uint64_t max_events;
+	double glitch_us;
+	double jitter_us;
+	char fmt;				// 't', 's' or 'v'
+	FILE* f;
+	trace_writer tw;
+	sct_writer sw;
+	vcd_writer vw;
+	int failed;
+} gen_opts;
+
+static int gen_option(void* ctx, int c, const char* arg)
+{
+	gen_opts* g = ctx;
+	switch ( c ) {
+	case 'P':
+		if ( !strcmp(arg, "ps2") ) {
+			g->cfg.proto = GEN_PS2;
+		} else if ( !strcmp(arg, "xt") ) {
+			g->cfg.proto = GEN_XT;
+		} else {
+			fprintf(stderr, "sctool: unknown protocol '%s'\n", arg);
+			return 0;
+		}
+		return 1;
+	case 'c':
+		g->cfg.clk = strtoul(arg, 0, 0);
+		return g->cfg.clk < 16;
+	case 'd':
+		g->cfg.dat = strtoul(arg, 0, 0);
+		return g->cfg.dat < 16;
+	case 'C':
+		g->cfg.clock_hz = strtoul(arg, 0, 0);
+		return g->cfg.clock_hz >= 1000 && g->cfg.clock_hz <= 40000;
+	case 'K':
+		g->cfg.key_rate = strtod(arg, 0);
+		return g->cfg.key_rate >= 0;
+	case 'H':
+		g->cfg.host_rate = strtod(arg, 0);
+		return g->cfg.host_rate >= 0;
+	case 'g':
+		g->cfg.glitch_rate = strtod(arg, 0);
+		return g->cfg.glitch_rate >= 0;
+	case 'w':
+		g->glitch_us = strtod(arg, 0);
+		return g->glitch_us > 0;
+	case 'J':
+		g->jitter_us = strtod(arg, 0);
+		return g->jitter_us >= 0;
+	case 'S':
+		g->cfg.seed = strtoull(arg, 0, 0);
+		return 1;
+	case 'n':
+		g->max_events = strtoull(arg, 0, 0);
+		return 1;
+	case 'f':
+		g->fmt = arg[0];
+		return !strcmp(arg, "txt") || !strcmp(arg, "sct") || !strcmp(arg, "vcd");
+	}
+	return 0;
+}
+
+static void gen_text(void* ctx, const char* text, size_t len)
+{
+	gen_opts* g = ctx;
+	if ( !g->failed && fwrite(text, 1, len, g->f) != len ) {
+		g->failed = errno ? errno : EIO;
+	}
+}
+
+static void gen_event(void* ctx, const trace_event* ev)
+{
+	gen_opts* g = ctx;
+	if ( g->failed ) {
+		return;
+	}
+	if ( g->fmt == 't' ) {
+		trace_writer_put(&g->tw, ev);
+	} else if ( g->fmt == 's' ? sct_writer_put(&g->sw, ev) : vcd_event(&g->vw, ev) ) {
+		g->failed = errno ? errno : EIO;
+	}
+}
+
+static int cmd_gen(int argc, char** argv)
+{
+	options o;
+	options_init(&o);
+	gen_opts g;
+	memset(&g, 0, sizeof(g));
+	gen_config_init(&g.cfg);
+	g.glitch_us = 0.5;
+	g.fmt = 't';
+	parse_options(&o, argc, argv, "P:c:d:C:K:H:g:w:J:S:n:f:", gen_option, &g);
+	if ( argc - optind != 1 || g.cfg.clk == g.cfg.dat ) {
+		fprintf(stderr, "usage: sctool gen [-p port] [-r hz] [-P ps2|xt] [-c clk] [-d data] [-C clock_hz]\n"
+			"\t[-K keys_per_s] [-H cmds_per_s] [-g glitches_per_s] [-w glitch_us] [-J jitter_us]\n"
+			"\t[-S seed] [-n events] [-e us] [-f txt|sct|vcd] out\n");
+		return 2;
+	}
+	if ( !(trace_channel_mask(o.port) & (1 << g.cfg.clk)) || !(trace_channel_mask(o.port) & (1 << g.cfg.dat)) ) {
+		fprintf(stderr, "sctool: port %c has no channel %u\n", o.port,
+			(trace_channel_mask(o.port) & (1 << g.cfg.clk)) ? g.cfg.dat : g.cfg.clk);
+		return 2;
+	}
+	g.cfg.tick_hz = o.tick_hz;
+	g.cfg.glitch_ticks = g.glitch_us * o.tick_hz / 1e6;
+	g.cfg.jitter_ticks = g.jitter_us * o.tick_hz / 1e6;
+	if ( !g.cfg.glitch_ticks ) {
+		g.cfg.glitch_ticks = 1;
+	}
+	uint64_t t_end = (o.t_end != UINT64_MAX) ? o.t_end : g.max_events ? 0 : 10ULL * o.tick_hz;
+
+	const char* out = argv[optind];
+	if ( g.fmt == 's' ) {
+		if ( sct_writer_open(&g.sw, out, o.port, o.tick_hz) ) {
+			fprintf(stderr, "sctool: %s: %s\n", out, strerror(errno));
+			return 1;
+		}
+	} else {
+		g.f = strcmp(out, "-") ? fopen(out, "w") : stdout;
+		if ( !g.f ) {
+			fprintf(stderr, "sctool: %s: %s\n", out, strerror(errno));
+			return 1;
+		}
+		setvbuf(g.f, 0, _IOFBF, 1 << 20);
+		if ( g.fmt == 't' ) {
+			trace_writer_init(&g.tw, o.port, gen_text, &g);
+		} else {
+			vcd_begin(&g.vw, g.f, o.port, o.tick_hz);
+		}
+	}
+
+	uint64_t n = gen_run(&g.cfg, t_end, g.max_events, gen_event, &g);
+	if ( !n ) {
+		fprintf(stderr, "sctool: gen: nothing to send, -K or -H must be above 0\n");
+	}
+
+	int err = 0;
+	if ( g.fmt == 's' ) {
+		err = sct_writer_close(&g.sw);
+	} else {
+		if ( g.fmt == 't' ) {
+			trace_writer_end(&g.tw);
+		} else {
+			err = vcd_end(&g.vw);
+		}
+		err |= fflush(g.f);
+		if ( g.f != stdout ) {
+			err |= fclose(g.f);
+		}
+	}
+	if ( err && !g.failed ) {
+		g.failed = errno ? errno : EIO;
+	}
+	if ( g.failed ) {
+		fprintf(stderr, "sctool: %s: %s\n", out, strerror(g.failed));
+		return 1;
+	}
+	return n ? 0 : 1;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static const struct command {
+	const char* name;
+	int (*fn)(int argc, char** argv);
+} commands[] = {
+	{ "import", cmd_import },
+	{ "capture", cmd_capture },
+	{ "cmd", cmd_cmd },
+	{ "dump", cmd_dump },
+	{ "info", cmd_info },
+	{ "vcd", cmd_vcd },
+	{ "sr", cmd_sr },
+	{ "lod", cmd_lod },
+	{ "view", cmd_view },
+	{ "decode", cmd_decode },
+	{ "ps2", cmd_ps2 },
+	{ "xt", cmd_xt },
+	{ "timing", cmd_timing },
+	{ "gen", cmd_gen },
+};
+
+int main(int argc, char** argv)
+{
+	if ( argc >= 2 ) {
+		for ( size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); ++i ) {
+			if ( !strcmp(argv[1], commands[i].name) ) {
+				return commands[i].fn(argc - 1, argv + 1);
+			}
+		}
+	}
+	fprintf(stderr, "usage: sctool <command> [options]\ncommands:");
+	for ( size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); ++i ) {
+		fprintf(stderr, " %s", commands[i].name);
+	}
+	fprintf(stderr, "\n");
+	return 2;
+}
@@ -0,0 +1,306 @@
+// Device output sources.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/hidraw.h>
+#include "source.h"
+#include "sctfile.h"
+
+// usb_debug_only.c: vendor defined usage page 0xFF31, usage 0x74, the same
+// thing hid_listen looks for (the VID/PID pair is shared by other PJRC code).
+static const unsigned char debug_usage[] = { 0x06, 0x31, 0xFF, 0x09, 0x74 };
+
+static int is_debug_hid(int fd)
+{
+	int size = 0;
+	struct hidraw_report_descriptor desc;
+	if ( ioctl(fd, HIDIOCGRDESCSIZE, &size) < 0 || size <= 0 ) {
+		return 0;
+	}
+	desc.size = size;
+	if ( ioctl(fd, HIDIOCGRDESC, &desc) < 0 ) {
+		return 0;
+	}
+	for ( int i = 0; i + (int)sizeof(debug_usage) <= size; ++i ) {
+		if ( !memcmp(desc.value + i, debug_usage, sizeof(debug_usage)) ) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int open_hid(int flags)
+{
+	for ( int i = 0; i < 64; ++i ) {
+		char path[32];
+		snprintf(path, sizeof(path), "/dev/hidraw%d", i);
+		int fd = open(path, flags);
+		if ( fd < 0 ) {
+			continue;
+		}
+		if ( is_debug_hid(fd) ) {
+			return fd;
+		}
+		close(fd);
+	}
+	errno = ENODEV;
+	return -1;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// replay
+
+struct source_replay {
+	uint32_t rate;			// bytes a second, 0 for no limit
+	uint64_t sent;
+	struct timespec t0;
+	int sct;				// printing a .sct file rather than reading fd
+	sct_reader r;
+	sct_cursor c;
+	trace_writer w;
+	int ended;				// all of the file printed
+	int failed;				// out of memory for text
+	char* text;				// printed but not read yet
+	size_t textlen;
+	size_t textpos;
+	size_t textcap;
+};
+
+static void replay_text(void* ctx, const char* text, size_t len)
+{
+	source_replay* r = ctx;
+	if ( r->textlen + len > r->textcap ) {
+		size_t cap = r->textcap ? r->textcap : TRACE_WRITE_BUF;
+		while ( cap < r->textlen + len ) {
+			cap *= 2;
+		}
+		char* p = realloc(r->text, cap);
+		if ( !p ) {
+			r->failed = 1;
+			return;
+		}
+		r->text = p;
+		r->textcap = cap;
+	}
+	memcpy(r->text + r->textlen, text, len);
+	r->textlen += len;
+}
+
+// spec is what follows SOURCE_REPLAY in the name: [@rate]:file
+static int replay_open(source* s, const char* spec)
+{
+	uint32_t rate = 0;
+	if ( *spec == '@' ) {
+		char* end;
+		rate = strtoul(spec + 1, &end, 0);
+		spec = rate ? end : "";
+	}
+	if ( *spec++ != ':' || !*spec ) {
+		errno = EINVAL;
+		return -1;
+	}
+	source_replay* r = calloc(1, sizeof(*r));
+	if ( !r ) {
+		return -1;
+	}
+	r->rate = rate;
+	clock_gettime(CLOCK_MONOTONIC, &r->t0);
+	if ( strcmp(spec, "-") && sct_probe(spec) ) {
+		if ( sct_open(&r->r, spec) ) {
+			free(r);
+			return -1;
+		}
+		r->sct = 1;
+		sct_cursor_seek(&r->c, &r->r, 0);
+		trace_writer_init(&r->w, r->r.info.port, replay_text, r);
+	} else {
+		s->fd = strcmp(spec, "-") ? open(spec, O_RDONLY) : 0;
+		if ( s->fd < 0 ) {
+			free(r);
+			return -1;
+		}
+	}
+	s->replay = r;
+	return 0;
+}
+
+static void replay_close(source* s)
+{
+	if ( s->replay->sct ) {
+		sct_close(&s->replay->r);
+	}
+	free(s->replay->text);
+	free(s->replay);
+	s->replay = 0;
+}
+
+static uint64_t replay_elapsed_us(const source_replay* r)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - r->t0.tv_sec) * 1000000ULL + (now.tv_nsec - r->t0.tv_nsec) / 1000;
+}
+
+// Bytes that may go out now, waiting up to timeout_ms for the first.
+static size_t replay_due(source_replay* r, size_t len, int timeout_ms)
+{
+	if ( !r->rate ) {
+		return len;
+	}
+	uint64_t us = replay_elapsed_us(r);
+	uint64_t due = us * r->rate / 1000000;
+	if ( due <= r->sent ) {
+		uint64_t wait_us = (r->sent + 1) * 1000000 / r->rate + 1 - us;
+		if ( wait_us > (uint64_t)timeout_ms * 1000 ) {
+			wait_us = (uint64_t)timeout_ms * 1000;
+		}
+		usleep(wait_us);
+		due = replay_elapsed_us(r) * r->rate / 1000000;
+		if ( due <= r->sent ) {
+			return 0;
+		}
+	}
+	return (due - r->sent < len) ? due - r->sent : len;
+}
+
+// Prints events from the .sct file into buf, returns 0 at the end.
+static ssize_t replay_print(source_replay* r, char* buf, size_t len)
+{
+	while ( r->textpos == r->textlen && !r->ended && !r->failed ) {
+		r->textpos = r->textlen = 0;
+		trace_event ev;
+		if ( sct_cursor_next(&r->c, &ev) ) {
+			trace_writer_put(&r->w, &ev);
+		} else {
+			trace_writer_end(&r->w);
+			r->ended = 1;
+		}
+	}
+	if ( r->failed ) {
+		errno = ENOMEM;
+		return -1;
+	}
+	size_t k = r->textlen - r->textpos;
+	if ( k > len ) {
+		k = len;
+	}
+	memcpy(buf, r->text + r->textpos, k);
+	r->textpos += k;
+	return k;
+}
+
+static int replay_read(source* s, char* buf, size_t len, int timeout_ms)
+{
+	source_replay* r = s->replay;
+	len = replay_due(r, len, timeout_ms);
+	if ( !len ) {
+		return 0;
+	}
+	ssize_t n = r->sct ? replay_print(r, buf, len) : read(s->fd, buf, len);
+	if ( n < 0 ) {
+		return (errno == EINTR || errno == EAGAIN) ? 0 : -1;
+	}
+	if ( !n ) {
+		errno = 0;
+		return -1;
+	}
+	r->sent += n;
+	return n;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// sources
+
+int source_open(source* s, const char* path)
+{
+	memset(s, 0, sizeof(*s));
+	s->name = path;
+	s->fd = -1;
+	size_t k = strlen(SOURCE_REPLAY);
+	if ( !strncmp(path, SOURCE_REPLAY, k) && (path[k] == ':' || path[k] == '@') ) {
+		return replay_open(s, path + k);
+	}
+	if ( !strcmp(path, SOURCE_HID) ) {
+		s->fd = open_hid(O_RDONLY);
+		s->hid = 1;
+	} else if ( !strcmp(path, "-") ) {
+		s->fd = 0;
+	} else {
+		s->fd = open(path, O_RDONLY);
+		s->hid = !strncmp(path, "/dev/hidraw", 11);
+	}
+	return s->fd < 0 ? -1 : 0;
+}
+
+void source_close(source* s)
+{
+	if ( s->replay ) {
+		replay_close(s);
+	}
+	if ( s->fd > 0 ) {
+		close(s->fd);
+	}
+	s->fd = -1;
+}
+
+int source_read(source* s, char* buf, size_t len, int timeout_ms)
+{
+	if ( s->replay ) {
+		return replay_read(s, buf, len, timeout_ms);
+	}
+	struct pollfd p = { s->fd, POLLIN, 0 };
+	int rc = poll(&p, 1, timeout_ms);
+	if ( rc < 0 ) {
+		return errno == EINTR ? 0 : -1;
+	}
+	if ( !rc ) {
+		return 0;
+	}
+	ssize_t n = read(s->fd, buf, len);
+	if ( n < 0 ) {
+		return (errno == EINTR || errno == EAGAIN) ? 0 : -1;
+	}
+	if ( !n ) {
+		errno = 0;
+		return -1;
+	}
+	if ( s->hid ) {
+		// usb_debug_flush_output() pads partial reports with zeros
+		size_t k = 0;
+		for ( ssize_t i = 0; i < n; ++i ) {
+			if ( buf[i] ) {
+				buf[k++] = buf[i];
+			}
+		}
+		n = k;
+	}
+	return n;
+}
+
+int source_command(const char* path, const char* cmd)
+{
+	int fd = strcmp(path, SOURCE_HID) ? open(path, O_WRONLY) : open_hid(O_WRONLY);
+	if ( fd < 0 ) {
+		return -1;
+	}
+	// report number 0, then the fixed size output report
+	char report[1 + SOURCE_CMD_SIZE];
+	memset(report, 0, sizeof(report));
+	size_t len = strlen(cmd);
+	memcpy(report + 1, cmd, len < SOURCE_CMD_SIZE ? len : SOURCE_CMD_SIZE);
+	ssize_t n = write(fd, report, sizeof(report));
+	int err = errno;
+	close(fd);
+	if ( n != (ssize_t)sizeof(report) ) {
+		errno = (n < 0) ? err : EIO;
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,46 @@
+#ifndef source_h__
+#define source_h__
+
+// Where device output comes from: the sctrace debug HID interface (what
+// hid_listen reads), or a file, tty or pipe standing in for it.
+//
+// A replay source stands in for the device without one: "replay:file" sends
+// a file of device output, or a .sct file printed as the firmware would
+// (see trace_writer), as fast as it's read. "replay@rate:file" paces it to
+// rate bytes a second instead; the debug HID interface manages at most
+// 64000 (a 64 byte report per 1ms frame).
+
+#include <stddef.h>
+
+// Name for source_open() that finds the first sctrace HID device.
+#define SOURCE_HID		"hid"
+// Prefix of a replay source name.
+#define SOURCE_REPLAY	"replay"
+
+typedef struct source_replay source_replay;
+
+typedef struct source {
+	int fd;
+	int hid;				// reads are whole reports, padded with NULs
+	const char* name;
+	source_replay* replay;	// 0 unless a replay source
+} source;
+
+// Opens SOURCE_HID, a /dev/hidraw node, "-" for stdin, a replay source or
+// any other file. Returns 0 on success.
+int source_open(source* s, const char* path);
+void source_close(source* s);
+
+// Reads whatever is available, waiting at most timeout_ms for it. Returns
+// the byte count, 0 if nothing arrived in time, or -1 at the end of the
+// input (errno 0) or on error.
+int source_read(source* s, char* buf, size_t len, int timeout_ms);
+
+// Output report size, DEBUG_RX_SIZE in usb_debug_only.h.
+#define SOURCE_CMD_SIZE	8
+
+// Sends a command (see sctrace.c, e.g. "S" for a stats line now) to the
+// device at SOURCE_HID or a /dev/hidraw path. Returns 0 on success.
+int source_command(const char* path, const char* cmd);
+
+#endif
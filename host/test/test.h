@@ -0,0 +1,45 @@
+#ifndef test_h__
+#define test_h__
+
+// Checks for the host unit tests (make test). Each test is a program of its
+// own that reports failed checks on stderr and exits nonzero if there were
+// any.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+
+static int test_failures;
+
+#define CHECK(cond) do { \
+	if ( !(cond) ) { \
+		fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+		++test_failures; \
+	} \
+} while ( 0 )
+
+#define CHECK_EQ(a, b) do { \
+	uint64_t a_ = (a), b_ = (b); \
+	if ( a_ != b_ ) { \
+		fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %llu != %llu\n", __FILE__, __LINE__, \
+			#a, #b, (unsigned long long)a_, (unsigned long long)b_); \
+		++test_failures; \
+	} \
+} while ( 0 )
+
+// Returns the exit status, after a line saying how the test went.
+static inline int test_done(const char* name)
+{
+	fprintf(stderr, "%s: %s\n", name, test_failures ? "FAILED" : "ok");
+	return test_failures ? 1 : 0;
+}
+
+// A scratch file path unique to this process, under $TMPDIR or /tmp.
+static inline void test_path(char* buf, size_t len, const char* name)
+{
+	const char* dir = getenv("TMPDIR");
+	snprintf(buf, len, "%s/sctool-test-%d-%s", dir ? dir : "/tmp", (int)getpid(), name);
+}
+
+#endif
@@ -0,0 +1,150 @@
+// The capture pipeline from a file of device output to a .sct file.
+
+#include <string.h>
+#include "../capture.h"
+#include "../sctfile.h"
+#include "test.h"
+
+#define WRAPPED	10
+
+// A chunk's worth of edges whose last few are after a wrap the device
+// gave no marker for, then a marker and later edges in the next chunk.
+static void write_input(const char* path)
+{
+	FILE* f = fopen(path, "w");
+	CHECK(f != 0);
+	if ( !f ) {
+		return;
+	}
+	for ( int i = 0; i < SCT_CHUNK_EVENTS - WRAPPED; ++i ) {
+		fprintf(f, "%04X%02X0 ", (i + 1) * 8, i & 1);
+	}
+	for ( int i = 0; i < WRAPPED; ++i ) {
+		fprintf(f, "%04X%02X0 ", 0x100 + i * 8, i & 1);
+	}
+	fprintf(f, "0200001 ");
+	for ( int i = 0; i < WRAPPED; ++i ) {
+		fprintf(f, "%04X%02X0 ", 0x300 + i * 8, i & 1);
+	}
+	fclose(f);
+}
+
+static void test_run(const char* in, const char* out)
+{
+	write_input(in);
+	capture_config cfg = { in, out, 'D', TRACE_TICK_HZ, 1 << 16 };
+	capture_stats st;
+	CHECK(!capture_run(&cfg, &st));
+	CHECK_EQ(st.tokens, SCT_CHUNK_EVENTS + 1 + WRAPPED);
+	CHECK_EQ(st.backwards, 0);
+	CHECK_EQ(st.dropped, 0);
+	CHECK_EQ(st.chunks, 2);
+
+	sct_reader r;
+	if ( sct_open(&r, out) ) {
+		CHECK(!"sct_open");
+		return;
+	}
+	CHECK_EQ(r.info.nevents, SCT_CHUNK_EVENTS + 1 + WRAPPED);
+	CHECK_EQ(r.info.t_first, 8);
+	CHECK_EQ(r.info.t_last, 0x10000 + 0x300 + (WRAPPED - 1) * 8);
+	sct_cursor c;
+	trace_event ev;
+	sct_cursor_seek(&c, &r, 0x10200);
+	CHECK(sct_cursor_next(&c, &ev));
+	CHECK_EQ(ev.t, 0x10200);
+	CHECK_EQ(ev.flags, 0);
+	sct_close(&r);
+}
+
+#define BACK	10
+
+// A chunk's worth of edges, then times that go back behind them (a "+"
+// token of 0 overflows clears the previous time, so no wrap is inferred)
+// just as the next chunk starts, then later ones again.
+static void write_backwards(const char* path)
+{
+	FILE* f = fopen(path, "w");
+	CHECK(f != 0);
+	if ( !f ) {
+		return;
+	}
+	for ( int i = 0; i < SCT_CHUNK_EVENTS; ++i ) {
+		fprintf(f, "%04X%02X0 ", (i + 1) * 8, i & 1);
+	}
+	fprintf(f, "+000000 ");
+	for ( int i = 0; i < BACK; ++i ) {
+		fprintf(f, "%04X%02X0 ", 0x100 + i * 8, i & 1);
+	}
+	fprintf(f, "+000001 ");
+	for ( int i = 0; i < BACK; ++i ) {
+		fprintf(f, "%04X%02X0 ", 0x100 + i * 8, i & 1);
+	}
+	fclose(f);
+}
+
+static void test_backwards(const char* in, const char* out)
+{
+	write_backwards(in);
+	capture_config cfg = { in, out, 'D', TRACE_TICK_HZ, 1 << 16 };
+	capture_stats st;
+	CHECK(!capture_run(&cfg, &st));
+	CHECK_EQ(st.tokens, SCT_CHUNK_EVENTS + 2 * BACK);
+	CHECK_EQ(st.backwards, BACK);
+	CHECK_EQ(st.dropped, 0);
+	CHECK_EQ(st.chunks, 2);
+
+	sct_reader r;
+	if ( sct_open(&r, out) ) {
+		CHECK(!"sct_open");
+		return;
+	}
+	CHECK_EQ(r.info.nevents, SCT_CHUNK_EVENTS + BACK);
+	CHECK_EQ(r.info.t_first, 8);
+	CHECK_EQ(r.info.t_last, 0x10000 + 0x100 + (BACK - 1) * 8);
+	sct_close(&r);
+}
+
+// PS2_DECODE_ENABLE firmware: the bytes go to a text file beside the .sct.
+static void test_ps2_bytes(const char* in, const char* out)
+{
+	FILE* f = fopen(in, "w");
+	CHECK(f != 0);
+	if ( !f ) {
+		return;
+	}
+	fprintf(f, "sctrace v1.02\nFFF0010 0000011 K0100AA405052BB40 K02001C000000B000\n");
+	fclose(f);
+	capture_config cfg = { in, out, 'D', TRACE_TICK_HZ, 1 << 16 };
+	capture_stats st;
+	CHECK(!capture_run(&cfg, &st));
+	CHECK_EQ(st.ps2_bytes, 2);
+
+	char path[300], text[512];
+	snprintf(path, sizeof(path), "%s%s", out, CAPTURE_PS2_SUFFIX);
+	f = fopen(path, "r");
+	CHECK(f != 0);
+	if ( !f ) {
+		return;
+	}
+	size_t n = fread(text, 1, sizeof(text) - 1, f);
+	text[n] = 0;
+	fclose(f);
+	unlink(path);
+	// 0x10100 ticks less 0xB40us, and 0x10200 ticks
+	CHECK(strstr(text, "      1232.000 host   AA  clock 80.0-82.0 us\n") != 0);
+	CHECK(strstr(text, "      4128.000 device 1C\n") != 0);
+}
+
+int main(void)
+{
+	char in[256], out[256];
+	test_path(in, sizeof(in), "capture.txt");
+	test_path(out, sizeof(out), "capture.sct");
+	test_run(in, out);
+	test_backwards(in, out);
+	test_ps2_bytes(in, out);
+	unlink(in);
+	unlink(out);
+	return test_done("capture");
+}
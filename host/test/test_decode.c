@@ -0,0 +1,109 @@
+// Parallel chunk decoding must match decoding the whole trace in one pass.
+
+#include <string.h>
+#include "../decode.h"
+#include "../gen.h"
+#include "test.h"
+
+#define MAX_FRAMES	16384
+
+typedef struct frames {
+	decode_frame f[MAX_FRAMES];
+	int n;
+} frames;
+
+static void on_frame(void* ctx, const decode_frame* f)
+{
+	frames* fr = ctx;
+	if ( fr->n < MAX_FRAMES ) {
+		fr->f[fr->n] = *f;
+	}
+	++fr->n;
+}
+
+static int same_frame(const decode_frame* a, const decode_frame* b)
+{
+	return a->t == b->t && a->t_end == b->t_end && a->min_period == b->min_period
+		&& a->max_period == b->max_period && a->min_setup == b->min_setup && a->min_hold == b->min_hold
+		&& a->value == b->value && a->dir == b->dir && a->flags == b->flags && a->bits == b->bits;
+}
+
+static void on_event(void* ctx, const trace_event* ev)
+{
+	sct_writer_put(ctx, ev);
+}
+
+static void write_trace(const char* path, uint8_t proto)
+{
+	gen_config g;
+	gen_config_init(&g);
+	g.proto = proto;
+	g.key_rate = 60;
+	g.host_rate = (proto == GEN_PS2) ? 10 : 0;
+	g.glitch_rate = 5;
+	g.glitch_ticks = 8;
+	g.jitter_ticks = 16;
+	g.seed = 7 + proto;
+	sct_writer w;
+	CHECK(!sct_writer_open(&w, path, 'D', TRACE_TICK_HZ));
+	gen_run(&g, 20ULL * TRACE_TICK_HZ, 0, on_event, &w);
+	CHECK(!sct_writer_close(&w));
+}
+
+static void decode_serial(sct_reader* r, const decoder_ops* ops, const decoder_config* cfg, frames* fr)
+{
+	void* d = malloc(ops->size);
+	ops->init(d, cfg, on_frame, fr);
+	sct_cursor c;
+	trace_event ev;
+	sct_cursor_seek(&c, r, 0);
+	while ( sct_cursor_next(&c, &ev) ) {
+		ops->event(d, &ev);
+	}
+	ops->finish(d);
+	free(d);
+}
+
+static void compare(const char* proto, uint8_t gen_proto, const char* path)
+{
+	static frames serial, parallel;
+	write_trace(path, gen_proto);
+	sct_reader r;
+	if ( sct_open(&r, path) ) {
+		CHECK(!"sct_open");
+		return;
+	}
+	CHECK(r.info.nchunks >= 8);
+	const decoder_ops* ops = decoder_find(proto);
+	CHECK(ops != 0);
+	decoder_config cfg = { 0, 1, DECODE_NO_CHANNEL, r.info.tick_hz, r.info.t_first };
+	memset(&serial, 0, sizeof(serial));
+	decode_serial(&r, ops, &cfg, &serial);
+	CHECK(serial.n > 1000 && serial.n < MAX_FRAMES);
+
+	static const unsigned threads[] = { 1, 2, 3, 8 };
+	for ( size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); ++i ) {
+		memset(&parallel, 0, sizeof(parallel));
+		CHECK(!decode_parallel(&r, ops, &cfg, threads[i], TRACE_TICK_HZ / 20, on_frame, &parallel));
+		CHECK_EQ(parallel.n, serial.n);
+		int differ = 0;
+		for ( int k = 0; k < serial.n && k < parallel.n && k < MAX_FRAMES; ++k ) {
+			differ += !same_frame(&serial.f[k], &parallel.f[k]);
+		}
+		if ( differ ) {
+			fprintf(stderr, "%s, %u threads: %d frames differ\n", proto, threads[i], differ);
+		}
+		CHECK_EQ(differ, 0);
+	}
+	sct_close(&r);
+}
+
+int main(void)
+{
+	char path[256];
+	test_path(path, sizeof(path), "decode.sct");
+	compare("ps2", GEN_PS2, path);
+	compare("xt", GEN_XT, path);
+	unlink(path);
+	return test_done("decode");
+}
@@ -0,0 +1,147 @@
+// VCD text and sigrok session contents.
+
+#include <string.h>
+#include "../export.h"
+#include "test.h"
+
+static void test_vcd(void)
+{
+	char* text = 0;
+	size_t len = 0;
+	FILE* f = open_memstream(&text, &len);
+	vcd_writer v;
+	CHECK(!vcd_begin(&v, f, 'D', 16000000));
+	static const trace_event events[] = {
+		{ 1000, 0x1, TRACE_EDGE },
+		{ 1016, 0x3, TRACE_EDGE },		// 1 us later
+		{ 1032, 0x3, 0 },				// a marker, no change
+		{ 1048, 0x0, TRACE_EDGE },
+		{ 1064, 0x0, 0 },
+	};
+	for ( size_t i = 0; i < sizeof(events) / sizeof(events[0]); ++i ) {
+		CHECK(!vcd_event(&v, &events[i]));
+	}
+	CHECK(!vcd_end(&v));
+	fclose(f);
+
+	CHECK(strstr(text, "$var wire 1 ! INT0 $end\n$var wire 1 \" INT1 $end\n"));
+	CHECK(strstr(text, "$var wire 1 $ INT3 $end\n$upscope $end\n"));
+	const char* body = strstr(text, "$enddefinitions $end\n");
+	CHECK(body && !strcmp(body + 21,
+		"#0\n$dumpvars\n1!\n0\"\n0#\n0$\n$end\n"
+		"#1000000\n1\"\n"
+		"#3000000\n0!\n0\"\n"
+		"#4000000\n"));
+	free(text);
+}
+
+static uint32_t crc32(const uint8_t* p, size_t len)
+{
+	uint32_t crc = 0xFFFFFFFF;
+	while ( len-- ) {
+		crc ^= *p++;
+		for ( int k = 0; k < 8; ++k ) {
+			crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+		}
+	}
+	return ~crc;
+}
+
+static uint32_t get16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+static uint32_t get32(const uint8_t* p) { return get16(p) | (get16(p + 2) << 16); }
+
+// Reads a stored zip entry, checking its CRC. Returns its data or 0.
+static const uint8_t* zip_entry(const uint8_t* zip, size_t size, const char* name, uint32_t* len)
+{
+	size_t off = 0;
+	while ( off + 30 <= size && get32(zip + off) == 0x04034B50 ) {
+		const uint8_t* h = zip + off;
+		uint32_t namelen = get16(h + 26);
+		uint32_t n = get32(h + 18);
+		const uint8_t* data = h + 30 + namelen;
+		if ( namelen == strlen(name) && !memcmp(h + 30, name, namelen) ) {
+			CHECK_EQ(get16(h + 8), 0);
+			CHECK_EQ(get32(h + 14), crc32(data, n));
+			*len = n;
+			return data;
+		}
+		off += 30 + namelen + n;
+	}
+	return 0;
+}
+
+static uint8_t* read_file(const char* path, size_t* size)
+{
+	FILE* f = fopen(path, "rb");
+	if ( !f ) {
+		return 0;
+	}
+	fseek(f, 0, SEEK_END);
+	*size = ftell(f);
+	rewind(f);
+	uint8_t* p = malloc(*size);
+	if ( fread(p, 1, *size, f) != *size ) {
+		free(p);
+		p = 0;
+	}
+	fclose(f);
+	return p;
+}
+
+static void test_sigrok(const char* path)
+{
+	// 1 MHz from 16 MHz ticks: 16 ticks a sample
+	sr_writer s;
+	CHECK(!sr_begin(&s, path, 'X', 16000000, 1000000));
+	static const trace_event events[] = {
+		{ 160, 0x001, TRACE_EDGE },
+		{ 320, 0x000, TRACE_EDGE },
+		{ 336, 0x810, TRACE_EDGE | TRACE_PCINT },
+	};
+	for ( size_t i = 0; i < sizeof(events) / sizeof(events[0]); ++i ) {
+		CHECK(!sr_event(&s, &events[i]));
+	}
+	CHECK(!sr_end(&s));
+
+	size_t size;
+	uint8_t* zip = read_file(path, &size);
+	if ( !zip ) {
+		CHECK(!"read_file");
+		return;
+	}
+	uint32_t len;
+	const uint8_t* p = zip_entry(zip, size, "version", &len);
+	CHECK(p && len == 1 && p[0] == '2');
+	p = zip_entry(zip, size, "metadata", &len);
+	char meta[1024] = "";
+	if ( p && len < sizeof(meta) ) {
+		memcpy(meta, p, len);
+		meta[len] = 0;
+	}
+	CHECK(strstr(meta, "total probes=12\n") && strstr(meta, "unitsize=2\n"));
+	CHECK(strstr(meta, "probe1=INT0\n") && strstr(meta, "probe12=PB7\n"));
+
+	// 10 samples of INT0 high, 1 low, then the final state
+	p = zip_entry(zip, size, "logic-1-1", &len);
+	CHECK_EQ(p ? len : 0, 12 * 2);
+	if ( p && len == 12 * 2 ) {
+		CHECK_EQ(get16(p), 0x001);
+		CHECK_EQ(get16(p + 9 * 2), 0x001);
+		CHECK_EQ(get16(p + 10 * 2), 0x000);
+		CHECK_EQ(get16(p + 11 * 2), 0x810);
+	}
+
+	// the end of central directory record lists all three entries
+	CHECK(size > 22 && get32(zip + size - 22) == 0x06054B50 && get16(zip + size - 22 + 10) == 3);
+	free(zip);
+}
+
+int main(void)
+{
+	char path[256];
+	test_path(path, sizeof(path), "export.sr");
+	test_vcd();
+	test_sigrok(path);
+	unlink(path);
+	return test_done("export");
+}
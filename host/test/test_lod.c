@@ -0,0 +1,129 @@
+// The level-of-detail index against rendering from the raw trace.
+
+#include <string.h>
+#include "../lod.h"
+#include "test.h"
+
+#define NEVENTS		20000
+
+static void write_trace(const char* path)
+{
+	sct_writer w;
+	CHECK(!sct_writer_open(&w, path, 'D', TRACE_TICK_HZ));
+	uint32_t x = 12345;
+	trace_event ev = { 0x30000 + 777, 0x5, TRACE_EDGE };
+	for ( uint32_t i = 0; i < NEVENTS; ++i ) {
+		x = x * 1103515245 + 12345;
+		ev.t += 1 + (x >> 16) % 20000;
+		ev.pins ^= 1 << ((x >> 8) & 3);
+		CHECK(!sct_writer_put(&w, &ev));
+	}
+	CHECK(!sct_writer_close(&w));
+}
+
+static int same_bucket(const lod_bucket* a, const lod_bucket* b)
+{
+	return a->first == b->first && a->lo == b->lo && a->hi == b->hi
+		&& !memcmp(a->edges, b->edges, sizeof(a->edges));
+}
+
+// A trace spanning more than 2^63 ticks stops at buckets of that width,
+// however coarse the base level.
+static void test_wide_buckets(const char* sct, const char* lod)
+{
+	sct_writer w;
+	CHECK(!sct_writer_open(&w, sct, 'D', TRACE_TICK_HZ));
+	trace_event ev = { 0x30000, 0x5, TRACE_EDGE };
+	CHECK(!sct_writer_put(&w, &ev));
+	for ( int i = 1; i <= 3; ++i ) {
+		ev.t = 0x3000000000000000ULL * i;
+		ev.pins ^= 1;
+		CHECK(!sct_writer_put(&w, &ev));
+	}
+	CHECK(!sct_writer_close(&w));
+
+	sct_reader r;
+	lod_index l;
+	if ( sct_open(&r, sct) ) {
+		CHECK(!"sct_open");
+		return;
+	}
+	CHECK(lod_build(&r, lod, LOD_MAX_SHIFT + 1));
+	CHECK(!lod_build(&r, lod, 62));
+	sct_close(&r);
+	if ( lod_open(&l, lod) ) {
+		CHECK(!"lod_open");
+		return;
+	}
+	CHECK_EQ(l.nlevels, 2);
+	lod_bucket all;
+	CHECK_EQ(lod_render(&l, 0, UINT64_MAX, 1, &all), 1);
+	CHECK_EQ(all.edges[0], 3);
+	lod_close(&l);
+
+	// nor is an index claiming more levels opened
+	FILE* f = fopen(lod, "r+b");
+	CHECK(f && fseek(f, 13, SEEK_SET) == 0 && fputc(63, f) == 63);
+	if ( f ) {
+		fclose(f);
+	}
+	CHECK(lod_open(&l, lod));
+}
+
+int main(void)
+{
+	char sct[256], lod[256];
+	test_path(sct, sizeof(sct), "lod.sct");
+	test_path(lod, sizeof(lod), "lod.lod");
+	write_trace(sct);
+
+	sct_reader r;
+	lod_index l;
+	if ( sct_open(&r, sct) ) {
+		CHECK(!"sct_open");
+		return test_done("lod");
+	}
+	CHECK(!lod_build(&r, lod, LOD_BASE_SHIFT));
+	if ( lod_open(&l, lod) ) {
+		CHECK(!"lod_open");
+		sct_close(&r);
+		return test_done("lod");
+	}
+	CHECK_EQ(l.t0, 0x30000);
+	CHECK_EQ(l.nchannels, 4);
+	CHECK_EQ(l.count[l.nlevels - 1], 1);
+
+	// With columns of whole buckets starting at t0, every level agrees with
+	// the raw trace, also past its end.
+	enum { WIDTH = 64 };
+	lod_bucket a[WIDTH], b[WIDTH];
+	for ( uint8_t k = 0; k < l.nlevels; ++k ) {
+		uint64_t t1 = l.t0 + ((uint64_t)WIDTH << (LOD_BASE_SHIFT + k));
+		CHECK_EQ(lod_render(&l, l.t0, t1, WIDTH, a), WIDTH);
+		CHECK_EQ(lod_render_raw(&r, l.t0, t1, WIDTH, b), WIDTH);
+		int bad = 0;
+		for ( int i = 0; i < WIDTH; ++i ) {
+			bad += !same_bucket(&a[i], &b[i]);
+		}
+		CHECK_EQ(bad, 0);
+	}
+
+	// the top bucket holds every edge after the first event's state
+	lod_bucket all;
+	CHECK_EQ(lod_render(&l, l.t0, l.t0 + (1ULL << (LOD_BASE_SHIFT + l.nlevels - 1)), 1, &all), 1);
+	CHECK_EQ(all.edges[0] + all.edges[1] + all.edges[2] + all.edges[3], NEVENTS - 1);
+
+	// columns finer than the base level are left to the raw trace
+	CHECK_EQ(lod_render(&l, l.t0, l.t0 + 1000, 100, a), 0);
+
+	lod_close(&l);
+	sct_close(&r);
+
+	// a .sct file isn't an index
+	CHECK(lod_open(&l, sct));
+
+	test_wide_buckets(sct, lod);
+	unlink(sct);
+	unlink(lod);
+	return test_done("lod");
+}
@@ -0,0 +1,183 @@
+// PS/2 frames built edge by edge, and generated traffic.
+
+#include <string.h>
+#include "../ps2.h"
+#include "../gen.h"
+#include "test.h"
+
+#define CLK		0x1			// channels 0 and 1
+#define DAT		0x2
+#define MAX_FRAMES	4096
+
+typedef struct frames {
+	decode_frame f[MAX_FRAMES];
+	int n;
+} frames;
+
+static void on_frame(void* ctx, const decode_frame* f)
+{
+	frames* fr = ctx;
+	if ( fr->n < MAX_FRAMES ) {
+		fr->f[fr->n] = *f;
+	}
+	++fr->n;
+}
+
+typedef struct wave {
+	ps2_decoder d;
+	frames fr;
+	uint64_t t;
+	uint16_t pins;
+} wave;
+
+static void wave_init(wave* w)
+{
+	decoder_config cfg = { 0, 1, DECODE_NO_CHANNEL, TRACE_TICK_HZ, UINT64_MAX };
+	memset(&w->fr, 0, sizeof(w->fr));
+	ps2_init(&w->d, &cfg, on_frame, &w->fr);
+	w->t = 1000;
+	w->pins = CLK | DAT;
+	trace_event ev = { w->t, w->pins, TRACE_EDGE };
+	ps2_event(&w->d, &ev);
+}
+
+// Sets one line dt ticks after the previous change.
+static void wave_set(wave* w, uint16_t line, int high, uint32_t dt)
+{
+	w->t += dt;
+	w->pins = high ? (w->pins | line) : (w->pins & ~line);
+	trace_event ev = { w->t, w->pins, TRACE_EDGE };
+	ps2_event(&w->d, &ev);
+}
+
+// Clocks out bits, first in bit 0: 80us periods at 16MHz, data set 440
+// ticks before each falling edge.
+static void wave_bits(wave* w, uint16_t bits, uint8_t n)
+{
+	for ( uint8_t i = 0; i < n; ++i ) {
+		wave_set(w, DAT, (bits >> i) & 1, 200);
+		wave_set(w, CLK, 0, 440);
+		wave_set(w, CLK, 1, 640);
+	}
+}
+
+// start, data, odd parity, stop
+static uint16_t frame_bits(uint8_t value)
+{
+	return (value << 1) | (!(__builtin_popcount(value) & 1) << 9) | (1 << 10);
+}
+
+static void test_device_frame(void)
+{
+	wave w;
+	wave_init(&w);
+	wave_bits(&w, frame_bits(0x1C), 11);
+	CHECK_EQ(w.fr.n, 1);
+	const decode_frame* f = &w.fr.f[0];
+	CHECK_EQ(f->value, 0x1C);
+	CHECK_EQ(f->dir, PS2_DEVICE);
+	CHECK_EQ(f->flags, 0);
+	CHECK_EQ(f->bits, 11);
+	CHECK_EQ(f->min_period, 1280);
+	CHECK_EQ(f->max_period, 1280);
+	CHECK_EQ(f->min_setup, 440);
+	CHECK_EQ(f->min_hold, 840);
+	CHECK(ps2_idle(&w.d));
+
+	wave_bits(&w, frame_bits(0x1C) ^ (1 << 9), 11);
+	wave_bits(&w, frame_bits(0x1C) & ~(1 << 10), 11);
+	CHECK_EQ(w.fr.n, 3);
+	CHECK_EQ(w.fr.f[1].flags, PS2_ERR_PARITY);
+	CHECK_EQ(w.fr.f[2].flags, PS2_ERR_STOP);
+}
+
+// The host inhibits the clock, pulls data low and lets the clock go; the
+// device then clocks 11 bits and its acknowledge.
+static void test_host_frame(void)
+{
+	wave w;
+	wave_init(&w);
+	for ( int ack = 0; ack < 2; ++ack ) {
+		wave_set(&w, CLK, 0, 4000);
+		wave_set(&w, DAT, 0, 2000);
+		wave_set(&w, CLK, 1, 100);
+		wave_bits(&w, frame_bits(0xED) | (ack << 11), 12);
+		wave_set(&w, DAT, 1, 200);
+	}
+	CHECK_EQ(w.fr.n, 2);
+	CHECK_EQ(w.fr.f[0].value, 0xED);
+	CHECK_EQ(w.fr.f[0].dir, PS2_HOST);
+	CHECK_EQ(w.fr.f[0].bits, 12);
+	CHECK_EQ(w.fr.f[0].flags, 0);
+	CHECK_EQ(w.fr.f[1].flags, PS2_ERR_ACK);
+}
+
+static void test_cut_frames(void)
+{
+	wave w;
+	wave_init(&w);
+	// the clock stops for longer than PS2_TIMEOUT_US
+	wave_bits(&w, frame_bits(0x55), 5);
+	wave_set(&w, DAT, 1, 40000);
+	CHECK_EQ(w.fr.n, 1);
+	CHECK_EQ(w.fr.f[0].flags, PS2_ERR_TIMEOUT);
+	CHECK_EQ(w.fr.f[0].bits, 5);
+
+	// the host inhibits the clock mid-frame
+	wave_bits(&w, frame_bits(0x55), 4);
+	wave_set(&w, CLK, 0, 200);
+	wave_set(&w, CLK, 1, 2000);
+	CHECK_EQ(w.fr.n, 2);
+	CHECK_EQ(w.fr.f[1].flags, PS2_ERR_ABORT);
+
+	// the trace ends mid-frame
+	wave_bits(&w, frame_bits(0x55), 3);
+	ps2_finish(&w.d);
+	CHECK_EQ(w.fr.n, 3);
+	CHECK_EQ(w.fr.f[2].flags, PS2_ERR_TIMEOUT);
+	CHECK_EQ(w.fr.f[2].bits, 3);
+}
+
+static void gen_event(void* ctx, const trace_event* ev)
+{
+	ps2_event(ctx, ev);
+}
+
+// Keys and LED commands from the generator: every frame clean, and every
+// host byte acknowledged with FA.
+static void test_generated(void)
+{
+	static frames fr;
+	ps2_decoder d;
+	decoder_config cfg = { 0, 1, DECODE_NO_CHANNEL, TRACE_TICK_HZ, UINT64_MAX };
+	gen_config g;
+	gen_config_init(&g);
+	g.key_rate = 40;
+	g.host_rate = 10;
+	g.jitter_ticks = 16;
+	ps2_init(&d, &cfg, on_frame, &fr);
+	gen_run(&g, 5ULL * TRACE_TICK_HZ, 0, gen_event, &d);
+	ps2_finish(&d);
+
+	CHECK(fr.n > 300 && fr.n < MAX_FRAMES);
+	int errors = 0, host = 0, unacked = 0;
+	for ( int i = 0; i < fr.n && i < MAX_FRAMES; ++i ) {
+		errors += fr.f[i].flags != 0;
+		if ( fr.f[i].dir == PS2_HOST ) {
+			++host;
+			unacked += i + 1 == fr.n || fr.f[i + 1].dir != PS2_DEVICE || fr.f[i + 1].value != 0xFA;
+		}
+	}
+	CHECK_EQ(errors, 0);
+	CHECK(host > 20);
+	CHECK_EQ(unacked, 0);
+}
+
+int main(void)
+{
+	test_device_frame();
+	test_host_frame();
+	test_cut_frames();
+	test_generated();
+	return test_done("ps2");
+}
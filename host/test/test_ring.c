@@ -0,0 +1,79 @@
+// The SPSC ring, wrapping in one thread and passing a sequence between two.
+
+#include <pthread.h>
+#include "../ring.h"
+#include "test.h"
+
+#define COUNT	1000000
+
+static void test_wrap(void)
+{
+	ring r;
+	CHECK(!ring_init(&r, sizeof(uint32_t), 5));
+	CHECK_EQ(r.mask, 7);
+	uint32_t in[8], out[8];
+	uint32_t next_in = 0, next_out = 0;
+	int bad = 0;
+	// writes of 3 and reads of 2 walk the indices round many times
+	for ( int k = 0; k < 100; ++k ) {
+		for ( int i = 0; i < 3; ++i ) {
+			in[i] = next_in + i;
+		}
+		next_in += ring_write(&r, in, 3);
+		size_t n = ring_read(&r, out, 2);
+		for ( size_t i = 0; i < n; ++i ) {
+			bad += out[i] != next_out++;
+		}
+	}
+	CHECK_EQ(bad, 0);
+	CHECK_EQ(ring_used(&r), 6);
+	// full: the write comes up short
+	CHECK_EQ(ring_write(&r, in, 3), 2);
+	CHECK_EQ(r.high, 8);
+	CHECK_EQ(ring_write(&r, in, 1), 0);
+	CHECK_EQ(ring_read(&r, out, 8), 8);
+	CHECK_EQ(ring_read(&r, out, 1), 0);
+	ring_free(&r);
+}
+
+static void* producer(void* arg)
+{
+	ring* r = arg;
+	uint32_t buf[37];
+	for ( uint32_t v = 0; v < COUNT; ) {
+		size_t n = 0;
+		while ( n < 37 && v + n < COUNT ) {
+			buf[n] = v + n;
+			++n;
+		}
+		v += ring_write(r, buf, n);
+	}
+	return 0;
+}
+
+static void test_threads(void)
+{
+	ring r;
+	CHECK(!ring_init(&r, sizeof(uint32_t), 256));
+	pthread_t t;
+	CHECK(!pthread_create(&t, 0, producer, &r));
+	uint32_t buf[53], next = 0;
+	int bad = 0;
+	while ( next < COUNT ) {
+		size_t n = ring_read(&r, buf, 53);
+		for ( size_t i = 0; i < n; ++i ) {
+			bad += buf[i] != next++;
+		}
+	}
+	pthread_join(t, 0);
+	CHECK_EQ(bad, 0);
+	CHECK(r.high <= 256);
+	ring_free(&r);
+}
+
+int main(void)
+{
+	test_wrap();
+	test_threads();
+	return test_done("ring");
+}
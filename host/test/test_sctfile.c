@@ -0,0 +1,123 @@
+// .sct writing and reading back, and rejecting broken files.
+
+#include <errno.h>
+#include <string.h>
+#include "../sctfile.h"
+#include "test.h"
+
+#define NEVENTS		(3 * SCT_CHUNK_EVENTS + 100)
+
+// Times with steps from 0 to beyond 32 bits, so the varints take every
+// length, and pins over all 12 channels.
+static void make_event(uint32_t i, trace_event* ev, uint64_t* t)
+{
+	static const uint64_t steps[] = { 0, 1, 0x7F, 0x80, 0x3FFF, 0x10000, 0x123456789ULL, 0x1FFFFFFFFFFFULL };
+	*t += steps[(i * 7) % 8] + (i & 0x0F);
+	ev->t = *t;
+	ev->pins = (i * 0x9E5) & 0x0FFF;
+	ev->flags = (i % 5) ? TRACE_EDGE | ((i & 1) ? TRACE_PCINT : 0) : 0;
+}
+
+static void write_file(const char* path)
+{
+	sct_writer w;
+	CHECK(!sct_writer_open(&w, path, 'X', TRACE_TICK_HZ));
+	uint64_t t = 0;
+	for ( uint32_t i = 0; i < NEVENTS; ++i ) {
+		trace_event ev;
+		make_event(i, &ev, &t);
+		CHECK(!sct_writer_put(&w, &ev));
+	}
+	// time may not go backwards
+	trace_event back = { t - 1, 0, TRACE_EDGE };
+	errno = 0;
+	CHECK(sct_writer_put(&w, &back) && errno == EINVAL);
+	CHECK(!sct_writer_close(&w));
+}
+
+static void test_round_trip(const char* path)
+{
+	write_file(path);
+	sct_reader r;
+	if ( sct_open(&r, path) ) {
+		CHECK(!"sct_open");
+		return;
+	}
+	CHECK_EQ(r.info.port, 'X');
+	CHECK_EQ(r.info.tick_hz, TRACE_TICK_HZ);
+	CHECK_EQ(r.info.nevents, NEVENTS);
+	CHECK_EQ(r.info.nchunks, 4);
+
+	sct_cursor c;
+	sct_cursor_seek(&c, &r, 0);
+	uint64_t t = 0;
+	uint32_t n = 0, bad = 0;
+	trace_event ev, want;
+	while ( sct_cursor_next(&c, &ev) ) {
+		make_event(n++, &want, &t);
+		bad += ev.t != want.t || ev.pins != want.pins || ev.flags != want.flags;
+	}
+	CHECK_EQ(n, NEVENTS);
+	CHECK_EQ(bad, 0);
+	CHECK_EQ(r.info.t_last, t);
+
+	// seeking lands on the first event at or after the time
+	t = 0;
+	for ( uint32_t i = 0; i <= 2 * SCT_CHUNK_EVENTS + 5; ++i ) {
+		make_event(i, &want, &t);
+	}
+	sct_cursor_seek(&c, &r, want.t - 1);
+	CHECK(sct_cursor_next(&c, &ev));
+	CHECK_EQ(ev.t, want.t);
+	CHECK_EQ(sct_find_chunk(&r, want.t), 2);
+	sct_close(&r);
+}
+
+static void patch32(const char* path, long offset, uint32_t v)
+{
+	FILE* f = fopen(path, "r+b");
+	uint8_t b[4] = { v, v >> 8, v >> 16, v >> 24 };
+	CHECK(f && !fseek(f, offset, SEEK_SET) && fwrite(b, 4, 1, f) == 1);
+	if ( f ) {
+		fclose(f);
+	}
+}
+
+static void test_bad_header(const char* path)
+{
+	sct_reader r;
+	// chunk_events (at 16) over what a writer makes would size the decode
+	// buffers from the file
+	write_file(path);
+	patch32(path, 16, SCT_CHUNK_EVENTS + 1);
+	errno = 0;
+	CHECK(sct_open(&r, path) && errno == EINVAL);
+	patch32(path, 16, 0);
+	CHECK(sct_open(&r, path));
+	// and a tick rate of 0 would divide by zero
+	write_file(path);
+	patch32(path, 8, 0);
+	CHECK(sct_open(&r, path));
+
+	// a writer that never got to sct_writer_close() left no index
+	sct_writer w;
+	CHECK(!sct_writer_open(&w, path, 'D', TRACE_TICK_HZ));
+	trace_event ev = { 1, 1, TRACE_EDGE };
+	CHECK(!sct_writer_put(&w, &ev));
+	fflush(w.f);
+	errno = 0;
+	CHECK(sct_open(&r, path) && errno == EINVAL);
+	CHECK(!sct_writer_close(&w));
+	CHECK(!sct_open(&r, path));
+	sct_close(&r);
+}
+
+int main(void)
+{
+	char path[256];
+	test_path(path, sizeof(path), "sctfile.sct");
+	test_round_trip(path);
+	test_bad_header(path);
+	unlink(path);
+	return test_done("sctfile");
+}
@@ -0,0 +1,88 @@
+// Histogram accuracy, and pulse widths and setup/hold on a known waveform.
+
+#include "../timing.h"
+#include "test.h"
+
+static void test_hist(void)
+{
+	// buckets follow each other without gaps
+	int gaps = 0;
+	for ( unsigned i = 0; i + 1 < HIST_BUCKETS; ++i ) {
+		gaps += hist_bucket_lo(i + 1) != hist_bucket_hi(i) + 1;
+	}
+	CHECK_EQ(gaps, 0);
+	CHECK_EQ(hist_bucket_hi(HIST_BUCKETS - 1), UINT64_MAX);
+
+	static hist h;
+	hist_init(&h);
+	CHECK_EQ(hist_percentile(&h, 50), 0);
+	hist_add(&h, 3);
+	hist_add(&h, 3);
+	hist_add(&h, 3);
+	hist_add(&h, 7);
+	// exact below HIST_SUB
+	CHECK_EQ(hist_percentile(&h, 50), 3);
+	CHECK_EQ(hist_percentile(&h, 99), 7);
+
+	hist_init(&h);
+	for ( uint64_t v = 1; v <= 10000; ++v ) {
+		hist_add(&h, v);
+	}
+	CHECK_EQ(h.count, 10000);
+	CHECK_EQ(h.min, 1);
+	CHECK_EQ(h.max, 10000);
+	CHECK_EQ(h.sum, 10000 * 10001 / 2);
+	uint64_t p50 = hist_percentile(&h, 50);
+	uint64_t p1 = hist_percentile(&h, 1);
+	CHECK(p50 >= 5000 - 5000 / HIST_SUB && p50 <= 5000 + 5000 / HIST_SUB);
+	CHECK(p1 >= 100 - 100 / HIST_SUB && p1 <= 100 + 100 / HIST_SUB);
+	uint64_t p100 = hist_percentile(&h, 100);
+	CHECK(p100 >= 10000 - 10000 / HIST_SUB && p100 <= 10000);
+}
+
+// Clock on channel 0 and data on channel 1: every 100 ticks data toggles,
+// the clock falls 30 ticks later and rises 50 after that. Channel 5 is
+// outside the mask and ignored.
+static void test_waveform(void)
+{
+	static timing tm;
+	timing_init(&tm, 0x0F, 0, 1, 90);
+	enum { N = 50 };
+	trace_event ev = { 0, 0x1, TRACE_EDGE };
+	timing_event(&tm, &ev);
+	for ( int k = 1; k <= N; ++k ) {
+		ev.t = 100 * k;
+		ev.pins ^= 0x2 | 0x20;
+		timing_event(&tm, &ev);
+		ev.t += 30;
+		ev.pins &= ~0x1;
+		timing_event(&tm, &ev);
+		ev.t += 50;
+		ev.pins |= 0x1;
+		timing_event(&tm, &ev);
+		// markers don't count as edges
+		ev.flags = 0;
+		timing_event(&tm, &ev);
+		ev.flags = TRACE_EDGE;
+	}
+	CHECK_EQ(tm.setup.count, N);
+	CHECK_EQ(tm.setup.min, 30);
+	CHECK_EQ(tm.setup.max, 30);
+	CHECK_EQ(tm.hold.count, N - 1);
+	CHECK_EQ(tm.hold.min, 70);
+	CHECK_EQ(tm.low[0].count, N);
+	CHECK_EQ(tm.low[0].min, 50);
+	CHECK_EQ(tm.high[0].count, N - 1);
+	CHECK_EQ(tm.high[0].max, 50);
+	// data pulses are 100 ticks, over max_ticks
+	CHECK_EQ(tm.high[1].count + tm.low[1].count, 0);
+	CHECK_EQ(tm.high[1].idle + tm.low[1].idle, N - 1);
+	CHECK_EQ(tm.high[5].count + tm.low[5].count + tm.high[5].idle + tm.low[5].idle, 0);
+}
+
+int main(void)
+{
+	test_hist();
+	test_waveform();
+	return test_done("timing");
+}
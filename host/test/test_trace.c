@@ -0,0 +1,268 @@
+// trace_parser against hand-written device output.
+
+#include <string.h>
+#include "../trace.h"
+#include "test.h"
+
+#define MAX_EVENTS	256
+
+typedef struct collected {
+	trace_event ev[MAX_EVENTS];
+	int n;
+	trace_byte b[4];
+	int nb;
+	char line[TRACE_LINE_MAX];
+	int nlines;
+} collected;
+
+static void on_event(void* ctx, const trace_event* ev)
+{
+	collected* c = ctx;
+	if ( c->n < MAX_EVENTS ) {
+		c->ev[c->n] = *ev;
+	}
+	++c->n;
+}
+
+static void on_byte(void* ctx, const trace_byte* b)
+{
+	collected* c = ctx;
+	if ( c->nb < 4 ) {
+		c->b[c->nb] = *b;
+	}
+	++c->nb;
+}
+
+static void on_line(void* ctx, const char* line)
+{
+	collected* c = ctx;
+	strcpy(c->line, line);
+	++c->nlines;
+}
+
+// Parses text fed a byte at a time, so every token spans feed calls.
+static void parse(collected* c, trace_parser* p, const char* text)
+{
+	memset(c, 0, sizeof(*c));
+	trace_parser_init(p, on_event, c);
+	trace_parser_on_byte(p, on_byte, c);
+	trace_parser_on_stats(p, on_line, c);
+	for ( const char* s = text; *s; ++s ) {
+		trace_parser_feed(p, s, 1);
+	}
+	trace_parser_finish(p);
+}
+
+static void check_event(const trace_event* ev, uint64_t t, uint16_t pins, uint8_t flags)
+{
+	CHECK_EQ(ev->t, t);
+	CHECK_EQ(ev->pins, pins);
+	CHECK_EQ(ev->flags, flags);
+}
+
+static void test_single_port(void)
+{
+	collected c;
+	trace_parser p;
+	parse(&c, &p, "sctrace v1.02\n0010010 0000011 0020000\r\n");
+	CHECK_EQ(c.n, 3);
+	CHECK_EQ(p.skipped, 2);
+	check_event(&c.ev[0], 0x00010, 0x01, TRACE_EDGE);
+	check_event(&c.ev[1], 0x10000, 0x01, 0);
+	check_event(&c.ev[2], 0x10020, 0x00, TRACE_EDGE);
+
+	// flags other than 0, 1 and 8..F aren't events on a single port
+	parse(&c, &p, "0010012 0010017 001001 zz10010");
+	CHECK_EQ(c.n, 0);
+	CHECK_EQ(p.skipped, 4);
+}
+
+// Older firmware drops markers, so a time going backwards is a wrap, and the
+// marker that follows must not count it again.
+static void test_inferred_wrap(void)
+{
+	collected c;
+	trace_parser p;
+	parse(&c, &p, "FFF0010 0005000 0008001 0010010 0000001 0020010");
+	CHECK_EQ(c.n, 6);
+	check_event(&c.ev[1], 0x10005, 0x00, TRACE_EDGE);
+	check_event(&c.ev[2], 0x10008, 0x00, 0);
+	check_event(&c.ev[3], 0x10010, 0x01, TRACE_EDGE);
+	check_event(&c.ev[4], 0x20000, 0x00, 0);
+	check_event(&c.ev[5], 0x20020, 0x01, TRACE_EDGE);
+}
+
+static void test_dual_port(void)
+{
+	collected c;
+	trace_parser p;
+	parse(&c, &p, "00100012 0020F000 00000011 00300013 0030000");
+	CHECK_EQ(c.n, 4);
+	// the flag is 0..2 with 3 digits of pins
+	CHECK_EQ(p.skipped, 1);
+	check_event(&c.ev[0], 0x00010, 0x001, TRACE_EDGE | TRACE_PCINT);
+	check_event(&c.ev[1], 0x00020, 0xF00, TRACE_EDGE);
+	check_event(&c.ev[2], 0x10000, 0x001, 0);
+	check_event(&c.ev[3], 0x10030, 0x00, TRACE_EDGE);
+}
+
+static void test_epoch_token(void)
+{
+	collected c;
+	trace_parser p;
+	parse(&c, &p, "FFF0010 0000011 0000011 +000003 0005000 +FFFFFF 0001010");
+	CHECK_EQ(c.n, 5);
+	check_event(&c.ev[2], 0x20000, 0x01, 0);
+	check_event(&c.ev[3], 0x50005, 0x00, TRACE_EDGE);
+	check_event(&c.ev[4], ((0x5ULL + 0xFFFFFF) << 16) | 0x0001, 0x01, TRACE_EDGE);
+
+	// "+" clears the previous time, so a low time after it isn't a wrap
+	parse(&c, &p, "8000010 +000001 0001000");
+	CHECK_EQ(c.n, 2);
+	check_event(&c.ev[1], 0x10001, 0x00, TRACE_EDGE);
+
+	parse(&c, &p, "+00001 +0000001 +00000G");
+	CHECK_EQ(c.n, 0);
+	CHECK_EQ(p.skipped, 3);
+}
+
+// Flag 8 + n, or 8 and a channel mask: an edge whose other edge wasn't
+// captured goes back in halfway since the previous edge event.
+static void test_missing_edge(void)
+{
+	collected c;
+	trace_parser p;
+	parse(&c, &p, "0010010 0030018");
+	CHECK_EQ(c.n, 3);
+	check_event(&c.ev[1], 0x20, 0x00, TRACE_EDGE);
+	check_event(&c.ev[2], 0x30, 0x01, TRACE_EDGE);
+
+	parse(&c, &p, "0010030 003003803");
+	CHECK_EQ(c.n, 3);
+	check_event(&c.ev[1], 0x20, 0x00, TRACE_EDGE);
+	check_event(&c.ev[2], 0x30, 0x03, TRACE_EDGE);
+
+	// not before a timer event in between, and timer events aren't edges
+	parse(&c, &p, "0010010 0020001 0030018");
+	CHECK_EQ(c.n, 4);
+	check_event(&c.ev[1], 0x10020, 0x00, 0);
+	check_event(&c.ev[2], 0x10020, 0x00, TRACE_EDGE);
+	check_event(&c.ev[3], 0x10030, 0x01, TRACE_EDGE);
+
+	// the mask must have a channel, and goes with flag 8 only
+	parse(&c, &p, "0010030 003003800 003003903");
+	CHECK_EQ(c.n, 1);
+	CHECK_EQ(p.skipped, 2);
+}
+
+static void test_byte_token(void)
+{
+	collected c;
+	trace_parser p;
+	parse(&c, &p, "FFF0010 K0100AA405052BB4 K0100AA405052BB4G K0100AA405052BB40");
+	CHECK_EQ(c.n, 1);
+	CHECK_EQ(c.nb, 1);
+	CHECK_EQ(p.skipped, 2);
+	CHECK_EQ(c.b[0].t, 0x10100);
+	CHECK_EQ(c.b[0].value, 0xAA);
+	CHECK_EQ(c.b[0].flags, TRACE_BYTE_HOST);
+	CHECK_EQ(c.b[0].min_us, 0x50);
+	CHECK_EQ(c.b[0].max_us, 0x52);
+	CHECK_EQ(c.b[0].span_us, 0xB40);
+	CHECK_EQ(c.b[0].bits, 11);
+}
+
+// Three edges on a channel give the predictor its intervals. "0" is then
+// channel 0 exactly on time, "o10" channel 1 at 0x40 after the last event.
+static void test_run_token(void)
+{
+	collected c;
+	trace_parser p;
+	parse(&c, &p, "0064010 00C8000 012C010 ~00 ~o10\n~0");
+	CHECK_EQ(c.n, 6);
+	check_event(&c.ev[3], 400, 0x00, TRACE_EDGE);
+	check_event(&c.ev[4], 500, 0x01, TRACE_EDGE);
+	check_event(&c.ev[5], 564, 0x03, TRACE_EDGE);
+	// a new line starts the prediction over
+	CHECK_EQ(p.skipped, 1);
+
+	// too few edges on the channel yet
+	parse(&c, &p, "0064010 00C8000 ~0");
+	CHECK_EQ(c.n, 2);
+	CHECK_EQ(p.skipped, 1);
+}
+
+static void test_report_lines(void)
+{
+	collected c;
+	trace_parser p;
+	parse(&c, &p, "0010010 STATS e0=1 ts=0\n0020000 MEM end=1 free=2\n");
+	CHECK_EQ(c.n, 2);
+	CHECK_EQ(c.nlines, 2);
+	CHECK(!strcmp(c.line, "MEM end=1 free=2"));
+	CHECK_EQ(p.skipped, 0);
+}
+
+static void to_parser(void* ctx, const char* text, size_t len)
+{
+	trace_parser_feed(ctx, text, len);
+}
+
+// What trace_writer prints parses back to the same edges, across short and
+// long gaps and on both kinds of port.
+static void test_writer(char port)
+{
+	static const uint64_t gaps[] = { 5, 0x10000, 0xFFFF, 3 * 0x10000 + 7, 0x20000, 2000000000000ULL, 0x1234567 };
+	enum { N = 64 };
+	trace_event in[N];
+	uint64_t t = 0x100;
+	uint16_t mask = trace_channel_mask(port);
+	for ( int i = 0; i < N; ++i ) {
+		t += gaps[i % 7];
+		in[i].t = t;
+		in[i].pins = (i * 0x5A5) & mask;
+		in[i].flags = TRACE_EDGE | ((port == 'X' && (i & 1)) ? TRACE_PCINT : 0);
+	}
+
+	collected c;
+	trace_parser p;
+	trace_writer w;
+	memset(&c, 0, sizeof(c));
+	trace_parser_init(&p, on_event, &c);
+	trace_writer_init(&w, port, to_parser, &p);
+	for ( int i = 0; i < N; ++i ) {
+		trace_writer_put(&w, &in[i]);
+		// markers passed in are left out
+		trace_event marker = { in[i].t + 1, in[i].pins, 0 };
+		trace_writer_put(&w, &marker);
+	}
+	trace_writer_end(&w);
+	trace_parser_finish(&p);
+
+	int n = 0, bad = 0;
+	for ( int i = 0; i < c.n && i < MAX_EVENTS; ++i ) {
+		if ( c.ev[i].flags & TRACE_EDGE ) {
+			const trace_event* e = &in[n++];
+			bad += c.ev[i].t != e->t || c.ev[i].pins != e->pins || c.ev[i].flags != e->flags;
+		}
+	}
+	CHECK(c.n < MAX_EVENTS);
+	CHECK_EQ(n, N);
+	CHECK_EQ(bad, 0);
+	CHECK_EQ(p.skipped, 2);		// the banner line
+}
+
+int main(void)
+{
+	test_single_port();
+	test_inferred_wrap();
+	test_dual_port();
+	test_epoch_token();
+	test_missing_edge();
+	test_byte_token();
+	test_run_token();
+	test_report_lines();
+	test_writer('D');
+	test_writer('X');
+	return test_done("trace");
+}
@@ -0,0 +1,192 @@
+// XT frames built edge by edge, with each kind of reset.
+
+#include <string.h>
+#include "../xt.h"
+#include "test.h"
+
+#define CLK		0x1			// channels 0, 1 and 2
+#define DAT		0x2
+#define RST		0x4
+#define MAX_FRAMES	16
+
+typedef struct wave {
+	xt_decoder d;
+	decode_frame f[MAX_FRAMES];
+	int n;
+	uint64_t t;
+	uint16_t pins;
+} wave;
+
+static void on_frame(void* ctx, const decode_frame* f)
+{
+	wave* w = ctx;
+	if ( w->n < MAX_FRAMES ) {
+		w->f[w->n] = *f;
+	}
+	++w->n;
+}
+
+static void wave_init(wave* w, uint8_t rst, uint64_t t_reset)
+{
+	decoder_config cfg = { 0, 1, rst, TRACE_TICK_HZ, t_reset };
+	memset(w, 0, sizeof(*w));
+	xt_init(&w->d, &cfg, on_frame, w);
+	w->t = 1000;
+	w->pins = CLK | DAT | RST;
+	trace_event ev = { w->t, w->pins, TRACE_EDGE };
+	xt_event(&w->d, &ev);
+}
+
+// Sets one line dt ticks after the previous change.
+static void wave_set(wave* w, uint16_t line, int high, uint64_t dt)
+{
+	w->t += dt;
+	w->pins = high ? (w->pins | line) : (w->pins & ~line);
+	trace_event ev = { w->t, w->pins, TRACE_EDGE };
+	xt_event(&w->d, &ev);
+}
+
+// Clocks out a frame: IBM's first start bit (0) if ibm, the start bit (1),
+// then value LSB first, in 80us periods at 16MHz.
+static void wave_frame(wave* w, uint8_t value, int ibm)
+{
+	uint16_t bits = ibm ? (value << 2) | 0x2 : (value << 1) | 0x1;
+	for ( uint8_t i = 0; i < 9 + ibm; ++i ) {
+		wave_set(w, DAT, (bits >> i) & 1, 200);
+		wave_set(w, CLK, 0, 440);
+		wave_set(w, CLK, 1, 640);
+	}
+	wave_set(w, DAT, 1, 200);
+}
+
+// sctrace resets the keyboard just before the capture, so the first
+// frame is its BAT response.
+static void test_start_reset(void)
+{
+	wave w;
+	wave_init(&w, DECODE_NO_CHANNEL, 1000);
+	wave_frame(&w, 0xAA, 1);
+	wave_frame(&w, 0x1E, 0);
+	CHECK_EQ(w.n, 3);
+	CHECK_EQ(w.f[0].dir, XT_RESET);
+	CHECK_EQ(w.f[0].t, 1000);
+	CHECK_EQ(w.f[0].flags, XT_BAT);
+	CHECK_EQ(w.f[1].dir, XT_DEVICE);
+	CHECK_EQ(w.f[1].value, 0xAA);
+	CHECK_EQ(w.f[1].flags, XT_START2 | XT_BAT);
+	CHECK_EQ(w.f[1].bits, 10);
+	CHECK_EQ(w.f[2].value, 0x1E);
+	CHECK_EQ(w.f[2].flags, 0);
+	CHECK_EQ(w.f[2].bits, 9);
+	CHECK_EQ(w.f[2].min_period, 1280);
+	CHECK_EQ(w.f[2].max_period, 1280);
+	CHECK(xt_idle(&w.d));
+
+	// without it (sctool -n) 0xAA is just a code
+	wave_init(&w, DECODE_NO_CHANNEL, UINT64_MAX);
+	wave_frame(&w, 0xAA, 1);
+	CHECK_EQ(w.n, 1);
+	CHECK_EQ(w.f[0].flags, XT_START2);
+}
+
+// The host holds clock low for 20ms, and the keyboard never answers.
+static void test_clock_reset(void)
+{
+	wave w;
+	wave_init(&w, DECODE_NO_CHANNEL, UINT64_MAX);
+	wave_set(&w, CLK, 0, 1000);
+	uint64_t t0 = w.t;
+	wave_set(&w, CLK, 1, 320000);
+	CHECK(!xt_idle(&w.d));
+	wave_frame(&w, 0x1E, 0);
+	CHECK_EQ(w.n, 2);
+	CHECK_EQ(w.f[0].dir, XT_RESET);
+	CHECK_EQ(w.f[0].t, t0);
+	CHECK_EQ(w.f[0].t_end, t0 + 320000);
+	CHECK_EQ(w.f[0].flags, XT_ERR_BAT);
+	CHECK_EQ(w.f[1].flags, XT_ERR_BAT);
+
+	// or answers too late: over XT_BAT_MS
+	wave_set(&w, CLK, 0, 1000);
+	wave_set(&w, CLK, 1, 320000);
+	wave_set(&w, DAT, 1, 4ULL * TRACE_TICK_HZ);
+	wave_frame(&w, 0xAA, 1);
+	CHECK_EQ(w.n, 4);
+	CHECK_EQ(w.f[2].flags, XT_ERR_BAT);
+	CHECK_EQ(w.f[3].flags, XT_START2);
+}
+
+// A captured reset line, pulsed mid-frame.
+static void test_reset_line(void)
+{
+	wave w;
+	wave_init(&w, 2, UINT64_MAX);
+	wave_set(&w, DAT, 0, 200);
+	wave_set(&w, CLK, 0, 440);
+	wave_set(&w, CLK, 1, 640);
+	wave_set(&w, DAT, 1, 200);
+	wave_set(&w, CLK, 0, 440);
+	wave_set(&w, CLK, 1, 640);
+	wave_set(&w, RST, 0, 1000);
+	uint64_t t0 = w.t;
+	wave_set(&w, RST, 1, 8000);
+	wave_frame(&w, 0xAA, 1);
+	// a start bit and no data lost isn't worth reporting
+	CHECK_EQ(w.n, 2);
+	CHECK_EQ(w.f[0].dir, XT_RESET);
+	CHECK_EQ(w.f[0].t, t0);
+	CHECK_EQ(w.f[0].t_end, t0 + 8000);
+	CHECK_EQ(w.f[0].flags, XT_BAT);
+}
+
+// A capture that starts with the clock low has no falling edge to time a
+// reset from.
+static void test_clock_low_at_start(void)
+{
+	wave w;
+	decoder_config cfg = { 0, 1, DECODE_NO_CHANNEL, TRACE_TICK_HZ, UINT64_MAX };
+	memset(&w, 0, sizeof(w));
+	xt_init(&w.d, &cfg, on_frame, &w);
+	w.t = 1000;
+	w.pins = DAT | RST;
+	wave_set(&w, CLK, 0, 0);
+	wave_set(&w, CLK, 1, 320000);
+	wave_frame(&w, 0x1E, 0);
+	CHECK_EQ(w.n, 1);
+	CHECK_EQ(w.f[0].dir, XT_DEVICE);
+	CHECK_EQ(w.f[0].value, 0x1E);
+	CHECK_EQ(w.f[0].flags, 0);
+}
+
+static void test_cut_frames(void)
+{
+	wave w;
+	wave_init(&w, DECODE_NO_CHANNEL, UINT64_MAX);
+	// clock stops after the start bit and two data bits
+	for ( int i = 0; i < 3; ++i ) {
+		wave_set(&w, DAT, 1, 200);
+		wave_set(&w, CLK, 0, 440);
+		wave_set(&w, CLK, 1, 640);
+	}
+	wave_set(&w, DAT, 0, 40000);
+	CHECK_EQ(w.n, 1);
+	CHECK_EQ(w.f[0].flags, XT_ERR_TIMEOUT);
+	CHECK_EQ(w.f[0].bits, 3);
+
+	// an IBM first start bit that no start bit follows
+	wave_set(&w, CLK, 0, 440);
+	wave_set(&w, CLK, 1, 640);
+	xt_finish(&w.d);
+	CHECK_EQ(w.n, 2);
+	CHECK_EQ(w.f[1].flags, XT_ERR_START);
+}
+
+int main(void)
+{
+	test_start_reset();
+	test_clock_reset();
+	test_reset_line();
+	test_clock_low_at_start();
+	test_cut_frames();
+	return test_done("xt");
+}
@@ -0,0 +1,134 @@
+// Pulse width and setup/hold statistics.
+
+#include <string.h>
+#include "timing.h"
+
+void hist_init(hist* h)
+{
+	memset(h, 0, sizeof(*h));
+	h->min = UINT64_MAX;
+}
+
+static unsigned bucket_of(uint64_t v)
+{
+	if ( v < HIST_SUB ) {
+		return v;
+	}
+	unsigned e = 63 - __builtin_clzll(v);
+	return (e - HIST_SUB_BITS + 1) * HIST_SUB + ((v >> (e - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+uint64_t hist_bucket_lo(unsigned i)
+{
+	if ( i < HIST_SUB ) {
+		return i;
+	}
+	unsigned e = i / HIST_SUB + HIST_SUB_BITS - 1;
+	return (uint64_t)(HIST_SUB + i % HIST_SUB) << (e - HIST_SUB_BITS);
+}
+
+uint64_t hist_bucket_hi(unsigned i)
+{
+	if ( i < HIST_SUB ) {
+		return i;
+	}
+	unsigned e = i / HIST_SUB + HIST_SUB_BITS - 1;
+	return hist_bucket_lo(i) + ((uint64_t)1 << (e - HIST_SUB_BITS)) - 1;
+}
+
+void hist_add(hist* h, uint64_t v)
+{
+	++h->count;
+	h->sum += v;
+	if ( v < h->min ) h->min = v;
+	if ( v > h->max ) h->max = v;
+	++h->bucket[bucket_of(v)];
+}
+
+uint64_t hist_percentile(const hist* h, double p)
+{
+	if ( !h->count ) {
+		return 0;
+	}
+	uint64_t rank = (uint64_t)(p / 100 * h->count + 0.5);
+	if ( rank < 1 ) rank = 1;
+	if ( rank > h->count ) rank = h->count;
+	uint64_t n = 0;
+	unsigned i = 0;
+	for ( ; i < HIST_BUCKETS - 1; ++i ) {
+		n += h->bucket[i];
+		if ( n >= rank ) {
+			break;
+		}
+	}
+	// the middle of the bucket, but never outside what was actually seen
+	uint64_t v = hist_bucket_lo(i) + (hist_bucket_hi(i) - hist_bucket_lo(i)) / 2;
+	if ( v > h->max ) v = h->max;
+	if ( v < h->min ) v = h->min;
+	return v;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void timing_init(timing* tm, uint16_t mask, uint8_t clk, uint8_t dat, uint64_t max_ticks)
+{
+	memset(tm, 0, sizeof(*tm));
+	tm->mask = mask;
+	tm->clk = 1 << clk;
+	tm->dat = 1 << dat;
+	tm->max_ticks = max_ticks;
+	for ( int c = 0; c < 16; ++c ) {
+		hist_init(&tm->high[c]);
+		hist_init(&tm->low[c]);
+	}
+	hist_init(&tm->setup);
+	hist_init(&tm->hold);
+}
+
+static void add(const timing* tm, hist* h, uint64_t v)
+{
+	if ( v > tm->max_ticks ) {
+		++h->idle;
+	} else {
+		hist_add(h, v);
+	}
+}
+
+void timing_event(timing* tm, const trace_event* ev)
+{
+	if ( !(ev->flags & TRACE_EDGE) ) {
+		return;
+	}
+	if ( !tm->have_pins ) {
+		tm->have_pins = 1;
+		tm->pins = ev->pins;
+		return;
+	}
+	uint16_t changed = (tm->pins ^ ev->pins) & tm->mask;
+	uint16_t old = tm->pins;
+	tm->pins = ev->pins;
+
+	// data change first: if a snapshot caught both, data moved before the clock
+	if ( changed & tm->dat ) {
+		if ( tm->hold_pending ) {
+			add(tm, &tm->hold, ev->t - tm->t_fall);
+			tm->hold_pending = 0;
+		}
+	}
+	if ( (changed & tm->clk) && !(ev->pins & tm->clk) ) {
+		if ( tm->seen & tm->dat ) {
+			add(tm, &tm->setup, ev->t - tm->t_change[__builtin_ctz(tm->dat)]);
+		}
+		tm->t_fall = ev->t;
+		tm->hold_pending = 1;
+	}
+
+	for ( uint16_t m = changed; m; m &= m - 1 ) {
+		int c = __builtin_ctz(m);
+		if ( tm->seen & (1 << c) ) {
+			add(tm, (old & (1 << c)) ? &tm->high[c] : &tm->low[c], ev->t - tm->t_change[c]);
+		}
+		tm->t_change[c] = ev->t;
+		tm->seen |= 1 << c;
+	}
+}
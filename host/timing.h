@@ -0,0 +1,64 @@
+#ifndef timing_h__
+#define timing_h__
+
+// Pulse width and clock-to-data timing statistics over a whole trace.
+//
+// Everything is gathered in one pass into fixed size log-linear histograms:
+// values below HIST_SUB are exact, above that each power of two is split
+// into HIST_SUB buckets, so a percentile is within 1/HIST_SUB (6%) of the
+// true value whatever the trace length. Min, max and mean are exact.
+//
+// Per channel the high and low pulse widths are recorded; for one clock and
+// data pair, the data setup time before and hold time after each falling
+// clock edge (where both PS/2 and XT sample). Intervals longer than
+// max_ticks are the bus sitting idle rather than bit timing, and are only
+// counted.
+
+#include "trace.h"
+
+#define HIST_SUB_BITS	4
+#define HIST_SUB		(1 << HIST_SUB_BITS)
+#define HIST_BUCKETS	((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+typedef struct hist {
+	uint64_t count;
+	uint64_t min;
+	uint64_t max;
+	uint64_t sum;
+	uint64_t idle;				// values over the limit, not in the buckets
+	uint64_t bucket[HIST_BUCKETS];
+} hist;
+
+void hist_init(hist* h);
+void hist_add(hist* h, uint64_t v);
+
+// Value at or below which p percent of the values fall, 0 if empty.
+uint64_t hist_percentile(const hist* h, double p);
+
+// Range of values counted in bucket i.
+uint64_t hist_bucket_lo(unsigned i);
+uint64_t hist_bucket_hi(unsigned i);
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+typedef struct timing {
+	uint16_t mask;				// channels present
+	uint16_t clk;				// channel masks for setup/hold
+	uint16_t dat;
+	uint64_t max_ticks;
+	uint8_t have_pins;
+	uint16_t pins;
+	uint64_t t_change[16];		// latest edge per channel
+	uint16_t seen;				// channels with t_change valid
+	uint64_t t_fall;			// latest falling clock edge
+	uint8_t hold_pending;		// falling clock edge not yet followed by a data change
+	hist high[16];
+	hist low[16];
+	hist setup;
+	hist hold;
+} timing;
+
+void timing_init(timing* tm, uint16_t mask, uint8_t clk, uint8_t dat, uint64_t max_ticks);
+void timing_event(timing* tm, const trace_event* ev);
+
+#endif
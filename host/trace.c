@@ -0,0 +1,437 @@
+// Parsing of sctrace device output.
+
+#include <string.h>
+#include "trace.h"
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// channels
+
+static const char* const port_d_names[] = { "INT0", "INT1", "INT2", "INT3" };
+static const char* const port_b_names[] = { "PB0", "PB1", "PB2", "PB3", "PB4", "PB5", "PB6", "PB7" };
+
+uint16_t trace_channel_mask(char port)
+{
+	switch ( port ) {
+	case 'B': return 0x00FF;
+	case 'X': return 0x0FFF;
+	default: return 0x000F;
+	}
+}
+
+const char* trace_channel_name(char port, uint8_t n)
+{
+	if ( !(trace_channel_mask(port) & (1 << n)) ) {
+		return 0;
+	}
+	if ( port == 'X' ) {
+		return (n < 4) ? port_d_names[n] : port_b_names[n - 4];
+	}
+	return (port == 'B') ? port_b_names[n] : port_d_names[n];
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// text parser
+
+static int unhex(char c)
+{
+	if ( c >= '0' && c <= '9' ) return c - '0';
+	if ( c >= 'A' && c <= 'F' ) return c - 'A' + 10;
+	if ( c >= 'a' && c <= 'f' ) return c - 'a' + 10;
+	return -1;
+}
+
+static int unhexn(const char* s, uint8_t n, uint32_t* v)
+{
+	uint32_t r = 0;
+	while ( n-- ) {
+		int d = unhex(*s++);
+		if ( d < 0 ) {
+			return 0;
+		}
+		r = (r << 4) | d;
+	}
+	*v = r;
+	return 1;
+}
+
+void trace_parser_init(trace_parser* p, trace_event_fn fn, void* ctx)
+{
+	memset(p, 0, sizeof(*p));
+	p->fn = fn;
+	p->ctx = ctx;
+}
+
+// The device only sends the first two overflow markers after each edge, and
+// an edge can read TCNT1 just after a wrap but be queued before the marker.
+// So a timestamp going backwards implies a wrap, and the marker that
+// follows such an edge must not be counted a second time. Current firmware
+// sends "+" tokens (see epoch_token) so that this never has to guess.
+static void unwrap(trace_parser* p, uint16_t t, uint8_t is_edge)
+{
+	if ( is_edge ) {
+		if ( t < p->last_t ) {
+			++p->epoch;
+			p->inferred = 1;
+		}
+	} else {
+		if ( !p->inferred || t < p->last_t ) {
+			++p->epoch;
+		}
+		p->inferred = 0;
+	}
+	p->last_t = t;
+}
+
+void trace_parser_on_stats(trace_parser* p, trace_line_fn fn, void* ctx)
+{
+	p->stats_fn = fn;
+	p->stats_ctx = ctx;
+}
+
+void trace_parser_on_byte(trace_parser* p, trace_byte_fn fn, void* ctx)
+{
+	p->byte_fn = fn;
+	p->byte_ctx = ctx;
+}
+
+// Collects the tokens of a stats line, returns 0 if the token isn't part of one.
+static int stats_token(trace_parser* p)
+{
+	if ( !p->in_stats ) {
+		if ( !(p->toklen == 5 && !memcmp(p->tok, "STATS", 5))
+		  && !(p->toklen == 4 && !memcmp(p->tok, "PROF", 4))
+		  && !(p->toklen == 3 && !memcmp(p->tok, "MEM", 3)) ) {
+			return 0;
+		}
+		p->in_stats = 1;
+		p->linelen = 0;
+	}
+	if ( p->linelen + p->toklen + 2 <= TRACE_LINE_MAX ) {
+		if ( p->linelen ) {
+			p->line[p->linelen++] = ' ';
+		}
+		memcpy(p->line + p->linelen, p->tok, p->toklen);
+		p->linelen += p->toklen;
+	}
+	return 1;
+}
+
+static void stats_end(trace_parser* p)
+{
+	if ( p->in_stats ) {
+		p->line[p->linelen] = 0;
+		if ( p->stats_fn ) {
+			p->stats_fn(p->stats_ctx, p->line);
+		}
+		p->in_stats = 0;
+	}
+}
+
+// KTTTTVVFFmmMMbSSS, see PS2_DECODE_ENABLE in sctrace.c.
+static int byte_token(trace_parser* p)
+{
+	uint32_t t, value, flags, min_us, max_us, span;
+	if ( p->toklen != 17 || p->tok[0] != 'K'
+	  || !unhexn(p->tok + 1, 4, &t) || !unhexn(p->tok + 5, 2, &value) || !unhexn(p->tok + 7, 2, &flags)
+	  || !unhexn(p->tok + 9, 2, &min_us) || !unhexn(p->tok + 11, 2, &max_us) || !unhexn(p->tok + 13, 4, &span) ) {
+		return 0;
+	}
+	// stamped with the event that ended the frame, so in order with the rest
+	unwrap(p, t, 1);
+	trace_byte b;
+	b.t = (p->epoch << 16) | t;
+	b.span_us = span & 0xFFF;
+	b.min_us = min_us;
+	b.max_us = max_us;
+	b.value = value;
+	b.flags = flags;
+	b.bits = span >> 12;
+	if ( p->byte_fn ) {
+		p->byte_fn(p->byte_ctx, &b);
+	}
+	return 1;
+}
+
+// +DDDDDD, Timer1 overflows the device counted that no marker went out for,
+// ahead of the event that follows them (see "Timer1 epochs" in sctrace.c).
+static int epoch_token(trace_parser* p)
+{
+	uint32_t d;
+	if ( p->toklen != 7 || p->tok[0] != '+' || !unhexn(p->tok + 1, 6, &d) ) {
+		return 0;
+	}
+	p->epoch += d;
+	p->last_t = 0;
+	p->inferred = 0;
+	return 1;
+}
+
+static void predict_reset(trace_predictor* pr)
+{
+	memset(pr->seen, 0, sizeof(pr->seen));
+	pr->synced = 0;
+}
+
+static void predict_event(trace_predictor* pr, uint16_t t, uint8_t pins)
+{
+	uint8_t changed = pins ^ pr->pins;
+	for ( uint8_t c = 0; changed; ++c, changed >>= 1 ) {
+		if ( changed & 1 ) {
+			pr->interval2[c] = pr->interval[c];
+			pr->interval[c] = t - pr->last[c];
+			pr->last[c] = t;
+			if ( pr->seen[c] < 3 ) {
+				++pr->seen[c];
+			}
+		}
+	}
+	pr->t = t;
+	pr->pins = pins;
+	pr->synced = 1;
+}
+
+// missed is the channels that had an edge since the previous edge event
+// that the device didn't capture.
+static void parse_event(trace_parser* p, uint16_t t, uint16_t pins, uint8_t f, uint16_t missed)
+{
+	// the flag digit is 1 for timer events
+	uint8_t is_edge = (f != 1);
+	unwrap(p, t, is_edge);
+	trace_event ev;
+	ev.t = (p->epoch << 16) | t;
+	if ( missed && p->have_prev && ev.t > p->prev_t && ev.t >= p->t_event ) {
+		trace_event missing;
+		missing.t = p->prev_t + (ev.t - p->prev_t) / 2;
+		if ( missing.t < p->t_event ) {
+			missing.t = p->t_event; // not before a timer event in between
+		}
+		missing.pins = p->prev_pins ^ missed;
+		missing.flags = TRACE_EDGE;
+		p->fn(p->ctx, &missing);
+	}
+	ev.pins = pins;
+	ev.flags = (is_edge ? TRACE_EDGE : 0) | (f == 2 ? TRACE_PCINT : 0);
+	++p->tokens;
+	if ( is_edge ) {
+		p->prev_t = ev.t;
+		p->prev_pins = ev.pins;
+		p->have_prev = 1;
+	}
+	p->t_event = ev.t;
+	p->fn(p->ctx, &ev);
+}
+
+static int sym_value(char c)
+{
+	if ( c >= '0' && c <= '9' ) return c - '0';
+	if ( c >= 'A' && c <= 'Z' ) return c - 'A' + 10;
+	if ( c >= 'a' && c <= 'z' ) return c - 'a' + 36;
+	if ( c == '#' ) return 62;
+	if ( c == '$' ) return 63;
+	return -1;
+}
+
+// A '~' token of codes, see PREDICT_ENABLE in sctrace.c. A code that can't
+// be placed loses the rest of the token.
+static int run_token(trace_parser* p)
+{
+	if ( p->tok[0] != '~' ) {
+		return 0;
+	}
+	trace_predictor* pr = &p->pred;
+	uint8_t i = 1;
+	while ( i < p->toklen ) {
+		int v[3];
+		v[0] = sym_value(p->tok[i++]);
+		uint8_t n = (v[0] < 0x20) ? 1 : (v[0] < 0x30) ? 2 : 3;
+		for ( uint8_t k = 1; k < n; ++k ) {
+			v[k] = (i < p->toklen) ? sym_value(p->tok[i++]) : -1;
+		}
+		uint8_t c = (v[0] < 0x20) ? v[0] >> 2 : (v[0] >> 1) & 0x07;
+		uint16_t t;
+		if ( v[0] < 0 || v[n - 1] < 0 || !pr->synced || (n < 3 && pr->seen[c] < 3) ) {
+			++p->skipped;
+			pr->synced = 0;
+			break;
+		}
+		if ( n == 1 ) {
+			int r = v[0] & 0x03;
+			t = pr->last[c] + pr->interval2[c] + ((r & 0x02) ? r - 4 : r);
+		} else if ( n == 2 ) {
+			int r = ((v[0] & 0x01) << 6) | v[1];
+			t = pr->last[c] + pr->interval2[c] + ((r & 0x40) ? r - 128 : r);
+		} else {
+			t = pr->t + (((v[0] & 0x01) << 12) | (v[1] << 6) | v[2]);
+		}
+		uint8_t pins = pr->pins ^ (1 << c);
+		predict_event(pr, t, pins);
+		parse_event(p, t, pins, 0, 0);
+	}
+	return 1;
+}
+
+static void parse_token(trace_parser* p)
+{
+	uint32_t t, pins, f;
+	if ( stats_token(p) || byte_token(p) || epoch_token(p) || run_token(p) ) {
+		return;
+	}
+	// 2 digits of pins with a flag of 0, 1 or 8..F, or 8 and a 2 digit mask
+	// of channels, or 3 from dual port firmware with a flag of 0..2
+	uint8_t npins = (p->toklen == 9) ? 2 : p->toklen - 5;
+	if ( p->toklen < 7 || p->toklen > 9
+	  || !unhexn(p->tok, 4, &t) || !unhexn(p->tok + 4, npins, &pins) || !unhexn(p->tok + 4 + npins, 1, &f)
+	  || (f >= npins && (npins == 3 || f < 8)) ) {
+		++p->skipped;
+		return;
+	}
+	uint32_t missed = (f >= 8) ? 1 << (f - 8) : 0;
+	if ( p->toklen == 9 && (f != 8 || !unhexn(p->tok + 7, 2, &missed) || !missed) ) {
+		++p->skipped;
+		return;
+	}
+	if ( npins == 2 ) {
+		predict_event(&p->pred, t, pins);
+	}
+	parse_event(p, t, pins, f, missed);
+}
+
+void trace_parser_feed(trace_parser* p, const char* buf, size_t len)
+{
+	while ( len-- ) {
+		char c = *buf++;
+		if ( c == ' ' || c == '\n' || c == '\r' || c == '\t' ) {
+			if ( p->toklen ) {
+				parse_token(p);
+				p->toklen = 0;
+			}
+			if ( c == '\n' ) {
+				stats_end(p);
+				predict_reset(&p->pred);
+			}
+		} else if ( p->toklen < TRACE_TOKEN_MAX ) {
+			p->tok[p->toklen++] = c;
+		}
+	}
+}
+
+void trace_parser_finish(trace_parser* p)
+{
+	if ( p->toklen ) {
+		parse_token(p);
+		p->toklen = 0;
+	}
+	stats_end(p);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// text writer
+
+// Firmware banner, and its tokens per line (items_per_line).
+#define TRACE_BANNER	"sctrace v1.02\n"
+#define TRACE_ITEMS		10
+// Longest token and its separator.
+#define TRACE_ITEM_MAX	10
+
+void trace_writer_init(trace_writer* w, char port, trace_text_fn fn, void* ctx)
+{
+	memset(w, 0, sizeof(*w));
+	w->port = port;
+	w->fn = fn;
+	w->ctx = ctx;
+	memcpy(w->buf, TRACE_BANNER, sizeof(TRACE_BANNER) - 1);
+	w->len = sizeof(TRACE_BANNER) - 1;
+}
+
+static void flush(trace_writer* w)
+{
+	if ( w->len ) {
+		w->fn(w->ctx, w->buf, w->len);
+		w->len = 0;
+	}
+}
+
+static char* put_hex(char* p, uint32_t v, uint8_t digits)
+{
+	static const char hex[] = "0123456789ABCDEF";
+	p += digits;
+	char* end = p;
+	while ( digits-- ) {
+		*--p = hex[v & 0x0F];
+		v >>= 4;
+	}
+	return end;
+}
+
+// Room for one more token.
+static char* put_item(trace_writer* w)
+{
+	if ( w->len + TRACE_ITEM_MAX > sizeof(w->buf) ) {
+		flush(w);
+	}
+	return w->buf + w->len;
+}
+
+static void put_item_end(trace_writer* w, char* p)
+{
+	if ( ++w->items == TRACE_ITEMS ) {
+		w->items = 0;
+		*p++ = '\n';
+	} else {
+		*p++ = ' ';
+	}
+	w->len = p - w->buf;
+}
+
+static void put_event(trace_writer* w, uint16_t t, uint16_t pins, uint8_t f)
+{
+	char* p = put_item(w);
+	p = put_hex(p, t, 4);
+	p = put_hex(p, pins, (w->port == 'X') ? 3 : 2);
+	p = put_hex(p, f, 1);
+	put_item_end(w, p);
+}
+
+// The longest overflow count a "+" token holds.
+#define TRACE_EPOCH_MAX	0xFFFFFF
+
+static void put_epochs(trace_writer* w, uint32_t d)
+{
+	char* p = put_item(w);
+	*p++ = '+';
+	p = put_hex(p, d, 6);
+	put_item_end(w, p);
+}
+
+void trace_writer_put(trace_writer* w, const trace_event* ev)
+{
+	if ( !(ev->flags & TRACE_EDGE) ) {
+		return;
+	}
+	uint64_t e = ev->t >> 16;
+	while ( w->epoch < e && w->markers < TRACE_MARKERS ) {
+		put_event(w, 0, w->pins, 1);
+		++w->epoch;
+		++w->markers;
+	}
+	while ( w->epoch < e ) {
+		uint64_t d = e - w->epoch;
+		if ( d > TRACE_EPOCH_MAX ) {
+			d = TRACE_EPOCH_MAX;
+		}
+		put_epochs(w, d);
+		w->epoch += d;
+	}
+	w->pins = ev->pins;
+	w->markers = 0;
+	put_event(w, ev->t, ev->pins, (ev->flags & TRACE_PCINT) ? 2 : 0);
+}
+
+void trace_writer_end(trace_writer* w)
+{
+	if ( w->items ) {
+		w->items = 0;
+		w->buf[w->len++] = '\n';
+	}
+	flush(w);
+}
@@ -0,0 +1,159 @@
+#ifndef trace_h__
+#define trace_h__
+
+// Host-side representation of sctrace captures.
+//
+// The device prints one token per event: 4 hex digits of Timer1, 2 hex
+// digits of port state and 1 hex digit flag (0 = pin change, 1 = Timer1
+// overflow). Dual port firmware (CAPTURE_PORT 'X') prints 3 digits of state
+// for its 12 channels, and flag 2 for a port B change. Firmware capturing
+// only one edge on some channels (EDGE_RISE_MASK/EDGE_FALL_MASK) prints flag
+// 8 + n for an edge on channel n whose opposite edge wasn't captured, or
+// flag 8 and 2 hex digits of a channel mask if several channels had one.
+// trace_parser turns that text back into absolute timestamps, putting such
+// missing edges back halfway between the edge events either side of them,
+// or just after a timer event in between if that comes later.
+// Firmware decoding PS/2 itself (PS2_DECODE_ENABLE) prints a "K" token per
+// byte instead of the edges, which the parser reports as a trace_byte.
+// Firmware with PREDICT_ENABLE packs most edges into "~" tokens of short
+// codes relative to a prediction the parser makes alongside the device.
+// A "+" token adds Timer1 overflows that went by without a marker, so that
+// the parser never has to infer a wrap from a timestamp going backwards.
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TRACE_TICK_HZ	16000000UL	// F_CPU with Timer1 at clock speed
+
+// trace_event.flags
+#define TRACE_EDGE		0x01	// pin change (otherwise a timer overflow marker)
+#define TRACE_PCINT		0x02	// caught by the port B pin change interrupt ('X' only)
+#define TRACE_FLAG_MASK	0x03	// flags that are kept in .sct files
+
+typedef struct trace_event {
+	uint64_t t;			// ticks since start of capture
+	uint16_t pins;		// pin states, bit n is channel n (see trace_channel_name)
+	uint8_t flags;
+} trace_event;
+
+typedef void (*trace_event_fn)(void* ctx, const trace_event* ev);
+
+// trace_byte.flags, besides the PS2_ERR_* flags (see ps2.h)
+#define TRACE_BYTE_HOST	0x40	// host to device
+
+// A PS/2 byte decoded by the device.
+typedef struct trace_byte {
+	uint64_t t;			// last clock edge, or when the frame was found cut short
+	uint32_t span_us;	// from the start of the frame to t
+	uint8_t min_us;		// clock period range, 0 if fewer than two edges
+	uint8_t max_us;
+	uint8_t value;
+	uint8_t flags;
+	uint8_t bits;		// clock edges seen
+} trace_byte;
+
+typedef void (*trace_byte_fn)(void* ctx, const trace_byte* b);
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// channels
+
+// Returns the channels present for a CAPTURE_PORT setting ('D', 'B' or 'X').
+uint16_t trace_channel_mask(char port);
+
+// Name of channel n for a CAPTURE_PORT setting, e.g. "INT0" or "PB7".
+const char* trace_channel_name(char port, uint8_t n);
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// text parser
+
+#define TRACE_TOKEN_MAX	128		// a full run of PREDICT_RUN_MAX codes
+#define TRACE_LINE_MAX	256
+
+// Called with a whole "STATS ...", "PROF ..." or "MEM ..." line (see
+// STATS_INTERVAL, PROFILE_ENABLE and STACK_PAINT_ENABLE in sctrace.c).
+typedef void (*trace_line_fn)(void* ctx, const char* line);
+
+// The device's edge prediction (PREDICT_ENABLE in sctrace.c), started over
+// at each newline.
+typedef struct trace_predictor {
+	uint16_t last[8];		// latest edge per channel
+	uint16_t interval[8];	// before it
+	uint16_t interval2[8];	// before that
+	uint8_t seen[8];		// edges since the start of the line, up to 3
+	uint16_t t;				// previous event
+	uint8_t pins;
+	uint8_t synced;			// an event has been seen since the start of the line
+} trace_predictor;
+
+typedef struct trace_parser {
+	trace_event_fn fn;
+	void* ctx;
+	uint64_t epoch;		// Timer1 overflows seen, sent as "+" tokens or inferred
+	uint16_t last_t;	// previous 16-bit timestamp
+	uint8_t inferred;	// wrap inferred from an edge, overflow marker not seen yet
+	uint64_t prev_t;	// previous edge event
+	uint16_t prev_pins;
+	uint8_t have_prev;
+	uint64_t t_event;	// latest event of any kind
+	trace_predictor pred;
+	uint8_t toklen;
+	char tok[TRACE_TOKEN_MAX];
+	uint64_t tokens;	// events parsed
+	uint64_t skipped;	// tokens that weren't events (banner, hid_listen chatter)
+	trace_line_fn stats_fn;
+	void* stats_ctx;
+	trace_byte_fn byte_fn;
+	void* byte_ctx;
+	uint8_t in_stats;
+	uint16_t linelen;
+	char line[TRACE_LINE_MAX];
+} trace_parser;
+
+void trace_parser_init(trace_parser* p, trace_event_fn fn, void* ctx);
+
+// Reports stats, profile and memory lines to fn; without this they are dropped.
+void trace_parser_on_stats(trace_parser* p, trace_line_fn fn, void* ctx);
+
+// Reports device decoded bytes to fn; without this they are dropped.
+void trace_parser_on_byte(trace_parser* p, trace_byte_fn fn, void* ctx);
+
+// Feeds any amount of device output; calls fn for each complete event.
+void trace_parser_feed(trace_parser* p, const char* buf, size_t len);
+
+// Flushes a trailing token not followed by whitespace.
+void trace_parser_finish(trace_parser* p);
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// text writer
+
+// Formats events the way the firmware prints them, for replaying .sct files
+// and synthesized traces as device output: overflow markers for the first
+// TRACE_MARKERS Timer1 overflows after each edge, and a "+" token for the
+// rest. Timer events passed in are dropped, since the writer makes its own.
+// The text goes to fn in blocks of up to TRACE_WRITE_BUF bytes.
+
+#define TRACE_WRITE_BUF	4096
+#define TRACE_MARKERS	2		// max_timer_events in sctrace.c
+
+typedef void (*trace_text_fn)(void* ctx, const char* text, size_t len);
+
+typedef struct trace_writer {
+	char port;
+	trace_text_fn fn;
+	void* ctx;
+	uint64_t epoch;		// Timer1 overflows the reader has been told of
+	uint16_t pins;
+	uint8_t markers;	// sent since the last edge
+	uint8_t items;		// tokens on the current line
+	size_t len;
+	char buf[TRACE_WRITE_BUF];
+} trace_writer;
+
+// Starts with the firmware's banner line.
+void trace_writer_init(trace_writer* w, char port, trace_text_fn fn, void* ctx);
+void trace_writer_put(trace_writer* w, const trace_event* ev);
+
+// Ends the last line and passes on what's left.
+void trace_writer_end(trace_writer* w);
+
+#endif
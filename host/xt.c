@@ -0,0 +1,220 @@
+// IBM PC/XT keyboard protocol decoder.
+
+#include <stdio.h>
+#include <string.h>
+#include "xt.h"
+
+// XT clock low periods are well under 100us, a host soft reset holds
+// clock low for around 20ms...
+#define XT_RESET_US		5000
+// ... the keyboard should answer within a second or two...
+#define XT_BAT_MS		3000
+// ... and a frame has ended if the clock stops for far longer than a bit time.
+#define XT_TIMEOUT_US	2000
+
+void xt_init(xt_decoder* d, const decoder_config* cfg, decode_frame_fn fn, void* ctx)
+{
+	memset(d, 0, sizeof(*d));
+	d->clk = 1 << cfg->clk;
+	d->dat = 1 << cfg->dat;
+	d->rst = (cfg->rst == DECODE_NO_CHANNEL) ? 0 : 1 << cfg->rst;
+	d->timeout_ticks = (uint64_t)cfg->tick_hz * XT_TIMEOUT_US / 1000000;
+	d->reset_ticks = (uint64_t)cfg->tick_hz * XT_RESET_US / 1000000;
+	d->bat_ticks = (uint64_t)cfg->tick_hz * XT_BAT_MS / 1000;
+	d->t_reset = cfg->t_reset;
+	d->fn = fn;
+	d->ctx = ctx;
+}
+
+static void reset_begin(xt_decoder* d, uint64_t t, uint64_t t_end)
+{
+	memset(&d->reset, 0, sizeof(d->reset));
+	d->reset.t = t;
+	d->reset.t_end = t_end;
+	d->reset.dir = XT_RESET;
+	d->reset_pending = 1;
+}
+
+static void reset_emit(xt_decoder* d, uint8_t flags)
+{
+	d->reset.flags |= flags;
+	d->fn(d->ctx, &d->reset);
+	d->reset_pending = 0;
+}
+
+static void frame_begin(xt_decoder* d, uint64_t t)
+{
+	memset(&d->f, 0, sizeof(d->f));
+	d->f.t = t;
+	d->f.dir = XT_DEVICE;
+	d->f.min_period = UINT32_MAX;
+	d->shift = 0;
+}
+
+static void frame_emit(xt_decoder* d, uint8_t flags)
+{
+	decode_frame* f = &d->f;
+	f->value = d->shift;
+	f->flags |= flags;
+	if ( !f->max_period ) {
+		f->min_period = 0;
+	}
+	if ( !flags && d->reset_pending ) {
+		// the first complete code after a reset is the BAT response
+		uint8_t bat = (f->value == 0xAA) ? XT_BAT : XT_ERR_BAT;
+		f->flags |= bat;
+		reset_emit(d, bat);
+	}
+	d->fn(d->ctx, f);
+	d->active = 0;
+	d->pre = 0;
+}
+
+// Drops a frame in progress, reporting it only if data bits were lost.
+static void frame_abort(xt_decoder* d)
+{
+	if ( d->active && d->f.bits > 1 + (d->pre ? 1 : 0) ) {
+		frame_emit(d, XT_ERR_ABORT);
+	}
+	d->active = 0;
+	d->pre = 0;
+}
+
+void xt_event(xt_decoder* d, const trace_event* ev)
+{
+	if ( !d->have_pins && d->t_reset != UINT64_MAX && ev->t >= d->t_reset
+	  && ev->t - d->t_reset < d->bat_ticks ) {
+		reset_begin(d, d->t_reset, d->t_reset);
+	}
+	if ( d->reset_pending && ev->t - d->reset.t_end > d->bat_ticks ) {
+		reset_emit(d, XT_ERR_BAT);
+	}
+	if ( (d->active || d->pre) && (d->pins & d->clk) && ev->t - d->t_fall > d->timeout_ticks ) {
+		frame_emit(d, d->active ? XT_ERR_TIMEOUT : XT_ERR_START);
+	}
+	if ( !(ev->flags & TRACE_EDGE) ) {
+		return;
+	}
+	if ( !d->have_pins ) {
+		d->have_pins = 1;
+		d->pins = ev->pins;
+		return;
+	}
+	uint16_t changed = d->pins ^ ev->pins;
+	d->pins = ev->pins;
+
+	if ( changed & d->rst ) {
+		if ( ev->pins & d->rst ) {
+			frame_abort(d);
+			reset_begin(d, d->t_rst, ev->t);
+		} else {
+			d->t_rst = ev->t;
+		}
+	}
+	if ( changed & d->dat ) {
+		if ( d->active && d->hold_pending ) {
+			uint64_t hold = ev->t - d->t_fall;
+			if ( !d->f.min_hold || hold < d->f.min_hold ) d->f.min_hold = hold;
+		}
+		d->hold_pending = 0;
+		d->t_dat = ev->t;
+	}
+	if ( !(changed & d->clk) ) {
+		return;
+	}
+	uint8_t data = (ev->pins & d->dat) ? 1 : 0;
+
+	if ( ev->pins & d->clk ) {
+		// rising: clock held low this long is the host resetting the keyboard
+		// (if the capture didn't start with it low)
+		if ( d->have_fall && ev->t - d->t_fall >= d->reset_ticks ) {
+			frame_abort(d);
+			reset_begin(d, d->t_fall, ev->t);
+		}
+		return;
+	}
+
+	// falling: sample data
+	uint64_t prev = d->t_fall;
+	d->t_fall = ev->t;
+	d->have_fall = 1;
+	decode_frame* f = &d->f;
+	if ( !d->active ) {
+		if ( !data ) {
+			// IBM first start bit (a repeat restarts it)
+			frame_begin(d, ev->t);
+			f->bits = 1;
+			f->t_end = ev->t;
+			d->pre = 1;
+			return;
+		}
+		if ( d->pre ) {
+			f->flags |= XT_START2;
+		} else {
+			frame_begin(d, ev->t);
+		}
+		d->active = 1;
+	}
+	if ( f->bits ) {
+		uint64_t period = ev->t - prev;
+		if ( period < f->min_period ) f->min_period = period;
+		if ( period > f->max_period ) f->max_period = period;
+	}
+	if ( f->bits > (d->pre ? 1 : 0) ) {
+		// a data bit, the start bit itself is always 1
+		uint64_t setup = ev->t - d->t_dat;
+		if ( setup && (!f->min_setup || setup < f->min_setup) ) {
+			f->min_setup = setup;
+		}
+		d->hold_pending = 1;
+		d->shift = (d->shift >> 1) | (data << 7);
+	}
+	f->t_end = ev->t;
+	if ( ++f->bits == 9 + (d->pre ? 1 : 0) ) {
+		frame_emit(d, 0);
+	}
+}
+
+void xt_finish(xt_decoder* d)
+{
+	if ( d->active || d->pre ) {
+		frame_emit(d, d->active ? XT_ERR_TIMEOUT : XT_ERR_START);
+	}
+	if ( d->reset_pending ) {
+		reset_emit(d, XT_ERR_BAT);
+	}
+}
+
+int xt_idle(const xt_decoder* d)
+{
+	return !d->active && !d->pre && !d->reset_pending;
+}
+
+const char* xt_dir_str(uint8_t dir)
+{
+	return (dir == XT_RESET) ? "reset" : "device";
+}
+
+const char* xt_flags_str(uint8_t flags, char* buf, size_t len)
+{
+	static const char* const names[] = { "start2", "start", "timeout", "abort", "bat", "nobat" };
+	size_t n = 0;
+	buf[0] = 0;
+	for ( uint8_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i ) {
+		if ( flags & (1 << i) ) {
+			n += snprintf(buf + n, n < len ? len - n : 0, "%s%s", n ? "," : "", names[i]);
+		}
+	}
+	return buf;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static void ops_init(void* d, const decoder_config* cfg, decode_frame_fn fn, void* ctx) { xt_init(d, cfg, fn, ctx); }
+static void ops_event(void* d, const trace_event* ev) { xt_event(d, ev); }
+static void ops_finish(void* d) { xt_finish(d); }
+static int ops_idle(const void* d) { return xt_idle(d); }
+
+const decoder_ops xt_decoder_ops = {
+	"xt", sizeof(xt_decoder), ops_init, ops_event, ops_finish, ops_idle, xt_flags_str, xt_dir_str
+};
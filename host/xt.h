@@ -0,0 +1,68 @@
+#ifndef xt_h__
+#define xt_h__
+
+// IBM PC/XT keyboard protocol decoder over the edge stream.
+//
+// XT keyboards only send. Data is sampled on each falling clock edge: a
+// start bit (1), then 8 data bits LSB first, with no parity or stop bit.
+// Genuine IBM keyboards precede the start bit with a second one sampled as
+// 0, which is reported with XT_START2.
+//
+// After a reset the keyboard answers with its BAT code, 0xAA. Resets come
+// from the -reset line (sctrace drives PB7 low before capturing starts,
+// which decoder_config.t_reset stands for), the reset line itself when it
+// is captured, or the host holding clock low. Each one is reported as an
+// XT_RESET frame once the keyboard's response (or the lack of it) is known.
+
+#include "trace.h"
+#include "decode.h"
+
+// decode_frame.dir
+#define XT_DEVICE		0		// scan code
+#define XT_RESET		1		// reset; t to t_end is the reset pulse if seen
+
+// decode_frame.flags
+#define XT_START2		0x01	// two start bits (IBM)
+#define XT_ERR_START	0x02	// first start bit not followed by the second
+#define XT_ERR_TIMEOUT	0x04	// clock stopped mid-frame
+#define XT_ERR_ABORT	0x08	// clock held low mid-frame
+#define XT_BAT			0x10	// scan code: BAT response; reset: answered with 0xAA
+#define XT_ERR_BAT		0x20	// reset: no 0xAA response in time; scan code: wrong response
+
+typedef struct xt_decoder {
+	uint16_t clk;			// channel masks
+	uint16_t dat;
+	uint16_t rst;			// 0 if not captured
+	uint32_t timeout_ticks;
+	uint32_t reset_ticks;	// clock low time that resets the keyboard
+	uint64_t bat_ticks;		// time allowed for the BAT response
+	uint64_t t_reset;
+	decode_frame_fn fn;
+	void* ctx;
+
+	uint8_t have_pins;
+	uint16_t pins;
+	uint8_t have_fall;
+	uint64_t t_fall;		// latest falling clock edge
+	uint64_t t_dat;			// latest data change
+	uint8_t hold_pending;
+	uint8_t pre;			// IBM first start bit seen
+	uint8_t active;			// in a frame, after the start bit
+	uint8_t shift;
+	decode_frame f;
+
+	uint8_t reset_pending;	// waiting for the BAT response
+	uint64_t t_rst;			// reset line went low
+	decode_frame reset;
+} xt_decoder;
+
+extern const decoder_ops xt_decoder_ops;
+
+void xt_init(xt_decoder* d, const decoder_config* cfg, decode_frame_fn fn, void* ctx);
+void xt_event(xt_decoder* d, const trace_event* ev);
+void xt_finish(xt_decoder* d);
+int xt_idle(const xt_decoder* d);
+const char* xt_flags_str(uint8_t flags, char* buf, size_t len);
+const char* xt_dir_str(uint8_t dir);
+
+#endif
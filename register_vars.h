@@ -6,9 +6,11 @@
 volatile register uint8_t pinstate	asm("r3");		// temporary for PIND during ISRs
 volatile register uint8_t tcnt1l	asm("r4");		// temporary for TCNT1L during ISRs
 volatile register uint8_t tcnt1h	asm("r5");		// temporary for TCNT1H during ISRs
-volatile register uint8_t eifrclr	asm("r6");		// global constant for clearing EIFR in ISRs
+volatile register uint8_t eifrclr	asm("r6");		// global constant for clearing EIFR in ISRs, and the INT pin mask in COMPACT_ISR
 // Some operations (e.g. andi) can only be performed on registers r16 and up...
 //volatile register uint8_t pinstate	asm("r16");		// temporary for PIND during ISRs
+volatile register uint8_t isrsreg	asm("r16");		// temporary for SREG during dual port and compact ISRs
+volatile register uint8_t isrflags	asm("r17");		// temporary for the flag byte of an input queue entry in ISRs
 // The X pointer register is r26 and r27...
 volatile register uint8_t iqhead		asm("r26");		// global head of queue
-volatile register uint8_t iqpage		asm("r27");		// global (constant) hi-byte of queue address
+volatile register uint8_t iqpage		asm("r27");		// global hi-byte of queue address, moving on through the IQPAGES pages
@@ -12,6 +12,7 @@
 #include <avr/io.h>
 #include <avr/pgmspace.h>
 #include <stdint.h>
+#include <string.h>
 #include <avr/interrupt.h>
 #include <util/delay.h>
 #include "usb_debug_only.h"
@@ -21,9 +22,15 @@
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 // Configuration...
 
-// Valid capture port settings are 'D' or 'B'.
+// Valid capture port settings are 'D', 'B' or 'X'.
 // 'D' uses external interrupts INT0 to INT 3.
-// 'B' uses the pin change interrupt, triggering on all 8 pins.
+// 'B' uses the pin change interrupt, triggering on all 8 pins. The host can
+// narrow that down with the 'M' command and two hex digits, e.g. M03 for PB0
+// and PB1 only, and pins left out then read as 0.
+// 'X' uses both at once, capturing 12 channels (INT0 to INT3, then PB0 to
+// PB7) and tagging each event with the interrupt that caught it. PB7 is left
+// out of the pin change mask if it's used for the reset output. The 'M'
+// command works on the port B channels here too.
 #ifndef CAPTURE_PORT
 #define CAPTURE_PORT 'D'
 #endif
@@ -32,6 +39,139 @@
 #ifndef RESET_OUTPUT_ENABLE
 #define RESET_OUTPUT_ENABLE 1
 #endif
+
+// Edges captured on each channel (bit n is channel n, as for the host): a
+// channel in both masks is captured on both edges, in one only on that edge,
+// in neither not at all. On port D this sets up the INT pins, on port B the
+// main loop drops changes that are only unwanted edges. E.g. for PS/2 with
+// the clock on channel 0, EDGE_RISE_MASK 0xFE halves the clock events.
+// A captured edge that implies a missing opposite edge on channel n is
+// flagged 8 + n, or if several channels are missing one, 8 and 2 hex digits
+// of their mask, so the host can put the missing edges back. Not supported
+// on both ports ('X').
+#ifndef EDGE_RISE_MASK
+#define EDGE_RISE_MASK 0xFFFF
+#endif
+#ifndef EDGE_FALL_MASK
+#define EDGE_FALL_MASK 0xFFFF
+#endif
+
+// If nonzero, each edge is held back until the next event shows whether the
+// line then stayed put for GLITCH_TICKS Timer1 ticks (16 is 1us at 16MHz).
+// A pulse shorter than that is dropped, and any other change that quick is
+// folded into the edge before it. Keep it below the shortest real pulse.
+// The last edge of a burst goes out with the next timer event.
+#ifndef GLITCH_TICKS
+#define GLITCH_TICKS 0
+#endif
+
+// If nonzero, the main loop decodes PS/2 frames (see host/ps2.h) with the
+// clock on channel PS2_CLOCK_CH and data on PS2_DATA_CH, and sends a record
+// per byte instead of the edges. That's a 17 character token, KTTTTVVFFmmMMbSSS:
+//	TTTT	Timer1 when the frame ended, or was found to have been cut short
+//	VV		the byte
+//	FF		PS2_ERR_* flags, plus 0x40 for host to device
+//	mm, MM	shortest and longest clock period, in us
+//	b		clock edges seen
+//	SSS		us from the start of the frame to TTTT
+// Timer events still go out so the host can keep time. Needs both edges.
+#ifndef PS2_DECODE_ENABLE
+#define PS2_DECODE_ENABLE 0
+#endif
+#ifndef PS2_CLOCK_CH
+#define PS2_CLOCK_CH 0
+#endif
+#ifndef PS2_DATA_CH
+#define PS2_DATA_CH 1
+#endif
+
+// If nonzero, edges are sent as short codes where they can be, packed into
+// tokens of up to PREDICT_RUN_MAX codes after a '~'. A code is one to three
+// 6 bit symbols (0-9, A-Z, a-z, '#', '$'), the first of which is one of:
+//	0cccrr				an edge on channel c (the only change), r ticks after
+//						the time predicted by repeating the interval before
+//						the last one on that channel, r from -2 to 1
+//	10cccr rrrrrr		the same, r from -64 to 63
+//	11cccd dddddd dddddd	an edge on channel c, d ticks after the previous event
+// Anything else still goes out as a token. Prediction starts over after
+// each newline, so lost output only garbles the rest of its line. Port D or
+// B only, and not with PS2_DECODE_ENABLE.
+#ifndef PREDICT_ENABLE
+#define PREDICT_ENABLE 0
+#endif
+#ifndef PREDICT_RUN_MAX
+#define PREDICT_RUN_MAX 32
+#endif
+
+// If nonzero, a line of statistics is output every STATS_INTERVAL Timer1
+// overflows (244 is about a second at 16MHz), counting since the previous one:
+//	e0..eN	edges per captured pin
+//	ts		timer events suppressed
+//	dr		events dropped because the output queue was full
+//	gl		events removed by the glitch filter
+//	iq, oq	input and output queue maximum depths, in entries
+//	to		USB putchar timeouts
+//	lp		main loop iterations
+// The host can also ask for one at any time with the 'S' command.
+#ifndef STATS_INTERVAL
+#define STATS_INTERVAL 244
+#endif
+
+// If 1, the main loop times its stages with a spare timer and outputs a
+// "PROF" line of cycle counts when the host sends the 'P' command, counting
+// since the previous one:
+//	lp		main loop iterations
+//	Xt, Xm	total and maximum cycles spent in stage X, which is one of
+//			iq (input queue to output queue), fm (formatting into obuf),
+//			us (USB send) and tk (usb_debug_task)
+#ifndef PROFILE_ENABLE
+#define PROFILE_ENABLE 0
+#endif
+
+// If 1, free RAM is painted at reset so that the host can ask with the 'W'
+// command how close the stack has ever come to the variables below it:
+//	end		end of .data/.bss (everything but the stack)
+//	free	bytes between end and the deepest the stack has reached
+//	top		top of RAM, where the stack starts
+#ifndef STACK_PAINT_ENABLE
+#define STACK_PAINT_ENABLE 1
+#endif
+
+// RAM kept out of the output queue for other variables and the stack.
+// "make memcheck" and the 'W' command show how much of it is needed.
+#ifndef STACK_RESERVE
+#define STACK_RESERVE 256
+#endif
+
+// Pages of 64 events in the input queue, 1, 2 or 4 (the Makefile's IQPAGES,
+// which also moves .data up past them). More pages let the ISRs ride out
+// longer stalls of the main loop, e.g. usb_debug_putchar() waiting for the
+// host, at the cost of output queue RAM and a cycle or two per event. They
+// don't help with USB control requests: USB_COM_vect answers those with
+// interrupts off, so edges during one are lost or stamped late whatever
+// the queue size.
+#ifndef IQPAGES
+#define IQPAGES 1
+#endif
+
+// If 1, port D events take 2 bytes in the input queue instead of 4: the low
+// 12 bits of the time and the INT pins, so each page holds 128. Timer0 then
+// adds an entry every 2048 ticks so that the main loop can rebuild the full
+// time, passing on one of those per Timer1 overflow as the timer event.
+// Those are 7812 entries a second, so a page still holds more edges than
+// with 4-byte entries, but only over stalls of up to about 8ms. At about 27
+// cycles each, with the interrupt's entry and reti, they also take 1.3% of
+// the CPU, and can delay an edge's interrupt by as many cycles.
+// Entries must never be 4096 or more ticks apart, so Timer0's interrupt may
+// be held off by under 2048 ticks (128us); any longer and the times after
+// it come out 4096 ticks early. USB_COM_vect runs with interrupts off, and
+// answering a GET_DESCRIPTOR request in it waits on the host for each
+// packet, so let the device enumerate before capturing. For the same
+// reason, the data of a SET_REPORT command is read by usb_debug_task() and
+// not in the interrupt.
+#ifndef IQ_COMPACT
+#define IQ_COMPACT 0
+#endif
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
@@ -39,14 +179,57 @@
 #define CAPTURE_PORT_IN			PIND
 #define INTERRUPT_FLAG_REG		EIFR
 #define INTERRUPT_FLAG_CLEAR	0x0F
+#define CAPTURE_PINS			4
+#define CAPTURE_MASK			0x000F
 #elif CAPTURE_PORT == 'B'
 #define CAPTURE_PORT_IN			PINB
 #define INTERRUPT_FLAG_REG		PCIFR
 #define INTERRUPT_FLAG_CLEAR	0x01
+#define CAPTURE_PINS			8
+#define CAPTURE_MASK			0x00FF
+#elif CAPTURE_PORT == 'X'
+#define INTERRUPT_FLAG_CLEAR	0x0F
+#define CAPTURE_PINS			12
+#define CAPTURE_MASK			0x0FFF
 #else
 #error "Invalid capture port setting"
 #endif
 
+// State of the captured pins, bit n is channel n...
+#if CAPTURE_PINS > 8
+typedef uint16_t pins_t;
+#else
+typedef uint8_t pins_t;
+#endif
+
+// Channels captured on one edge only, and whether any aren't on both...
+#define EDGE_SINGLE ((EDGE_RISE_MASK ^ EDGE_FALL_MASK) & CAPTURE_MASK)
+#define EDGE_SELECT ((EDGE_RISE_MASK & EDGE_FALL_MASK & CAPTURE_MASK) != CAPTURE_MASK)
+
+#if CAPTURE_PORT == 'X' && EDGE_SELECT
+#error "Edge selection is not supported when capturing on both ports"
+#endif
+
+#if PS2_DECODE_ENABLE && EDGE_SELECT
+#error "PS/2 decoding needs both edges of every channel"
+#endif
+
+#if PREDICT_ENABLE && (CAPTURE_PORT == 'X' || PS2_DECODE_ENABLE)
+#error "Predictive encoding is only for edges from port D or B"
+#endif
+
+#if IQ_COMPACT && CAPTURE_PORT != 'D'
+#error "Compact input queue entries are only for port D"
+#endif
+
+#if IQ_COMPACT && GLITCH_TICKS
+#error "The glitch filter needs full input queue entries"
+#endif
+
+// INT pin sense control, per pin 01 = both edges, 10 = falling, 11 = rising...
+#define EDGE_ISC(n) (((EDGE_RISE_MASK >> (n)) & 1) ? (((EDGE_FALL_MASK >> (n)) & 1) ? 1 : 3) : 2)
+#define EDGE_EICRA (EDGE_ISC(0) | (EDGE_ISC(1) << 2) | (EDGE_ISC(2) << 4) | (EDGE_ISC(3) << 6))
+
 #if CAPTURE_PORT == 'B' && RESET_OUTPUT_ENABLE
 #warning "Reset output cannot be enabled while capturing on Port B"
 #undef RESET_OUTPUT_ENABLE
@@ -71,7 +254,40 @@
 // high byte of input queue address...
 #define IQPAGE 1
 
+#if IQ_COMPACT
+#define IQENTRYSZ 2
+#else
 #define IQENTRYSZ 4
+#endif
+#define IQSZ (IQPAGES * 256)
+
+#if IQPAGES == 1
+// The ISRs wrap X within the page by reloading r27, so the head is just r26.
+typedef uint8_t iqpos_t;
+#define IQ_HEAD()		iqhead
+#define IQ_NEXT(pos)	((iqpos_t)((pos) + IQENTRYSZ))
+#elif IQPAGES == 2 || IQPAGES == 4
+// The ISRs let X run on into the next page and only reset r27 at the end of
+// the last one, so the head offset needs both halves of X, read together.
+typedef uint16_t iqpos_t;
+#define IQ_HEAD()		iq_head()
+#define IQ_NEXT(pos)	((iqpos_t)((pos) + IQENTRYSZ) & (IQSZ - 1))
+
+inline iqpos_t iq_head(void)
+{
+	uint8_t lo, hi;
+	asm volatile (
+		"cli"			"\n\t"
+		"mov %0, r26"	"\n\t"
+		"mov %1, r27"	"\n\t"
+		"sei"			"\n\t"
+		: "=r" (lo), "=r" (hi)
+	);
+	return ((uint16_t)(hi - IQPAGE) << 8) | lo;
+}
+#else
+#error "IQPAGES must be 1, 2 or 4"
+#endif
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
@@ -80,38 +296,367 @@ inline char hex(uint8_t v)
 	return (v + ((v < 10) ? '0' : 'A' - 10));
 }
 
+// Writes v as the given number of hex digits, returns the end.
+static char* puthex(char* p, uint32_t v, uint8_t digits)
+{
+	p += digits;
+	char* end = p;
+	while ( digits-- ) {
+		*--p = hex(v & 0x0F);
+		v >>= 4;
+	}
+	return end;
+}
+
+// avr-libc's strcpy_P, memcpy and memset use the X register, which holds the
+// input queue head (see register_vars.h), so these loops stand in for them.
+// The volatile keeps GCC from turning them back into library calls.
+
+// Copies the PROGMEM string s to p, returns the end.
+static inline char* putstr_P(char* p, PGM_P s)
+{
+	char c;
+	while ( (c = pgm_read_byte(s++)) ) {
+		*p++ = c;
+	}
+	*p = 0;
+	return p;
+}
+
+static inline void bytes_copy(void* dst, const void* src, uint8_t n)
+{
+	volatile uint8_t* d = dst;
+	const uint8_t* s = src;
+	while ( n-- ) {
+		*d++ = *s++;
+	}
+}
+
+static inline void bytes_clear(void* dst, uint8_t n)
+{
+	volatile uint8_t* d = dst;
+	while ( n-- ) {
+		*d++ = 0;
+	}
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// statistics
+
+#if STATS_INTERVAL
+
+#define STAT(x) x
+
+typedef struct stats_t {
+	uint32_t edges[CAPTURE_PINS];
+	uint32_t loops;
+	uint16_t timer_skipped;
+	uint16_t oq_dropped;
+	uint16_t glitches;
+	uint16_t oq_max;
+	uint16_t usb_timeouts;
+	uint16_t iq_max;
+} stats_t;
+
+stats_t stats; // being counted
+stats_t stats_out; // being output
+
+// Formats field n (from 1) of the stats line, returns the next field or 0 after the last.
+static uint8_t stats_format(char* p, uint8_t n)
+{
+	static const char PROGMEM names[] = "tsdrgliqoqtolp";
+	if ( n == 1 ) {
+		putstr_P(p, PSTR("STATS "));
+		return 2;
+	}
+	if ( n < 2 + CAPTURE_PINS ) {
+		*p++ = 'e';
+		*p++ = hex(n - 2);
+		*p++ = '=';
+		p = puthex(p, stats_out.edges[n - 2], 8);
+		*p++ = ' ';
+		*p = 0;
+		return n + 1;
+	}
+	uint8_t k = n - (2 + CAPTURE_PINS);
+	*p++ = pgm_read_byte(&names[2 * k]);
+	*p++ = pgm_read_byte(&names[2 * k + 1]);
+	*p++ = '=';
+	switch ( k ) {
+	case 0: p = puthex(p, stats_out.timer_skipped, 4); break;
+	case 1: p = puthex(p, stats_out.oq_dropped, 4); break;
+	case 2: p = puthex(p, stats_out.glitches, 4); break;
+	case 3: p = puthex(p, stats_out.iq_max, (IQPAGES == 1) ? 2 : 4); break;
+	case 4: p = puthex(p, stats_out.oq_max, 4); break;
+	case 5: p = puthex(p, stats_out.usb_timeouts, 4); break;
+	default:
+		p = puthex(p, stats_out.loops, 8);
+		*p++ = '\n';
+		*p = 0;
+		return 0;
+	}
+	*p++ = ' ';
+	*p = 0;
+	return n + 1;
+}
+
+#else
+#define STAT(x)
+#endif
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// profiling
+
+#if PROFILE_ENABLE
+
+// Reading Timer1 here would share its 16-bit TEMP register with the capture
+// ISRs, so use another timer: Timer3 at clock speed where there is one,
+// otherwise (32U2) 8-bit Timer0 at clock/8, which limits a stage to 2048 cycles.
+#ifdef TCNT3
+#define PROFILE_TIMER_INIT()	(TCCR3A = 0x00, TCCR3B = 0x01)
+#define PROFILE_NOW()			TCNT3
+#define PROFILE_SHIFT			0
+typedef uint16_t prof_t;
+#else
+#define PROFILE_TIMER_INIT()	(TCCR0A = 0x00, TCCR0B = 0x02)
+#define PROFILE_NOW()			TCNT0
+#define PROFILE_SHIFT			3
+typedef uint8_t prof_t;
+#endif
+
+#define PROF_IQ		0
+#define PROF_FMT	1
+#define PROF_USB	2
+#define PROF_TASK	3
+#define PROF_STAGES	4
+
+typedef struct profile_t {
+	uint32_t total[PROF_STAGES];
+	uint16_t max[PROF_STAGES];
+	uint32_t loops;
+} profile_t;
+
+profile_t prof; // being counted
+profile_t prof_out; // being output
+
+inline void prof_add(uint8_t stage, prof_t ticks)
+{
+	uint16_t cycles = (uint16_t)ticks << PROFILE_SHIFT;
+	prof.total[stage] += cycles;
+	if ( cycles > prof.max[stage] ) {
+		prof.max[stage] = cycles;
+	}
+}
+
+// Starts timing a main loop iteration, then each PROF_STAGE() ends a stage.
+#define PROF_START()	prof_t prof_t0 = PROFILE_NOW(); ++prof.loops
+#define PROF_STAGE(s)	do { prof_t t1 = PROFILE_NOW(); prof_add((s), t1 - prof_t0); prof_t0 = t1; } while ( 0 )
+
+// Formats field n (from 1) of the profile line, returns the next field or 0 after the last.
+static uint8_t profile_format(char* p, uint8_t n)
+{
+	static const char PROGMEM names[] = "iqfmustk";
+	if ( n == 1 ) {
+		putstr_P(p, PSTR("PROF "));
+		return 2;
+	}
+	if ( n == 2 ) {
+		p = puthex(putstr_P(p, PSTR("lp=")), prof_out.loops, 8);
+		*p++ = ' ';
+		*p = 0;
+		return 3;
+	}
+	uint8_t k = (n - 3) / 2;
+	uint8_t is_max = (n - 3) & 1;
+	*p++ = pgm_read_byte(&names[2 * k]);
+	*p++ = pgm_read_byte(&names[2 * k + 1]);
+	if ( is_max ) {
+		*p++ = 'm';
+		*p++ = '=';
+		p = puthex(p, prof_out.max[k], 4);
+	} else {
+		*p++ = 't';
+		*p++ = '=';
+		p = puthex(p, prof_out.total[k], 8);
+	}
+	if ( k == PROF_STAGES - 1 && is_max ) {
+		*p++ = '\n';
+		*p = 0;
+		return 0;
+	}
+	*p++ = ' ';
+	*p = 0;
+	return n + 1;
+}
+
+#else
+#define PROF_START()
+#define PROF_STAGE(s)
+#endif
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// stack watermark
+
+#if STACK_PAINT_ENABLE
+
+#define STACK_CANARY 0xC5
+
+// From the linker: end of .bss and top of the stack.
+extern uint8_t _end;
+extern uint8_t __stack;
+
+// Runs from .init1, before there is a stack or even a zero register, so
+// fills _end..__stack with the canary in plain asm.
+void stack_paint(void) __attribute__((naked, used, section(".init1")));
+void stack_paint(void)
+{
+	asm volatile
+	(
+		"ldi r30, lo8(_end)"		"\n\t"
+		"ldi r31, hi8(_end)"		"\n\t"
+		"ldi r24, %[canary]"		"\n\t"
+		"ldi r25, hi8(__stack)"		"\n\t"
+		"rjmp 2f"					"\n\t"
+		"1: st Z+, r24"				"\n\t"
+		"2: cpi r30, lo8(__stack)"	"\n\t"
+		"cpc r31, r25"				"\n\t"
+		"brlo 1b"					"\n\t"
+		"breq 1b"					"\n\t"
+		:
+		: [canary] "M" (STACK_CANARY)
+	);
+}
+
+uint8_t* mem_scan; // next byte to check for the watermark, 0 if none wanted
+uint16_t mem_free; // result
+
+// Checks a few more bytes for the first one the stack has overwritten, so
+// that a scan never holds up the main loop. Returns 1 once found.
+static uint8_t mem_scan_step(void)
+{
+	for ( uint8_t i = 0; i < 8; ++i ) {
+		if ( mem_scan > &__stack || *mem_scan != STACK_CANARY ) {
+			mem_free = mem_scan - &_end;
+			mem_scan = 0;
+			return 1;
+		}
+		++mem_scan;
+	}
+	return 0;
+}
+
+// Formats field n (from 1) of the memory line, returns the next field or 0 after the last.
+static uint8_t mem_format(char* p, uint8_t n)
+{
+	switch ( n ) {
+	case 1:
+		p = puthex(putstr_P(p, PSTR("MEM end=")), (uint16_t)&_end, 4);
+		break;
+	case 2:
+		p = puthex(putstr_P(p, PSTR(" free=")), mem_free, 4);
+		break;
+	default:
+		p = puthex(putstr_P(p, PSTR(" top=")), (uint16_t)&__stack, 4);
+		*p++ = '\n';
+		*p = 0;
+		return 0;
+	}
+	*p = 0;
+	return n + 1;
+}
+
+#endif
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// report lines
+
+// Lines output in place of events, a field at a time...
+#define REPORTS_ENABLE (STATS_INTERVAL || PROFILE_ENABLE || STACK_PAINT_ENABLE)
+#define REPORT_STATS	1
+#define REPORT_PROFILE	2
+#define REPORT_MEM		3
+
+#if REPORTS_ENABLE
+static uint8_t report_format(char* p, uint8_t report, uint8_t n)
+{
+#if STATS_INTERVAL
+	if ( report == REPORT_STATS ) {
+		return stats_format(p, n);
+	}
+#endif
+#if PROFILE_ENABLE
+	if ( report == REPORT_PROFILE ) {
+		return profile_format(p, n);
+	}
+#endif
+#if STACK_PAINT_ENABLE
+	if ( report == REPORT_MEM ) {
+		return mem_format(p, n);
+	}
+#endif
+	return 0;
+}
+#endif
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 // output queue
 
-// Let output queue use all of RAM except for input queue (256 bytes),
-// and other data variables + stack (256 bytes is generous)...
+// Let output queue use all of RAM except for input queue (IQSZ bytes),
+// and other data variables + stack (STACK_RESERVE)...
+// That's 512 entries on the 32U4, 1920 on the AT90USB1286.
 #define OQENTRYSZ 4
-#define OQSZ (((RAM_SIZE - 512) / OQENTRYSZ) * OQENTRYSZ)
+#define OQLEN ((RAM_SIZE - IQSZ - STACK_RESERVE) / OQENTRYSZ)
+#define OQSZ (OQLEN * OQENTRYSZ)
+
+#if OQLEN < 64
+#error "Not enough RAM for the output queue"
+#endif
+
+// Byte offsets of the next entry to write and to read. If OQLEN is a power
+// of two (the 32U4 and 32U2 with one input queue page) they run free and
+// are masked on access, so head - tail is the fill level and a full queue
+// needs no spare entry. Otherwise, so as not to give up the rest of the
+// RAM, they wrap back to 0 at OQSZ and one entry is kept spare to tell a
+// full queue from an empty one.
+#if OQLEN & (OQLEN - 1)
+#define OQ_AT(pos)		(pos)
+#define OQ_NEXT(pos)	((pos) == OQSZ - OQENTRYSZ ? 0 : (pos) + OQENTRYSZ)
+#define OQ_FILL()		((uint16_t)(oqhead - oqtail + (oqhead < oqtail ? OQSZ : 0)))
+#define OQ_ROOM			(OQLEN - 1) // entries that can be queued
+#else
+#define OQ_AT(pos)		((pos) & (OQSZ - 1))
+#define OQ_NEXT(pos)	((pos) + OQENTRYSZ)
+#define OQ_FILL()		((uint16_t)(oqhead - oqtail))
+#define OQ_ROOM			OQLEN
+#endif
 
 uint8_t oqueue[OQSZ];
-uint8_t* oqhead = oqueue;
-uint8_t* oqtail = oqueue;
+uint16_t oqhead;
+uint16_t oqtail;
 
-inline uint8_t* oqnext(uint8_t* p)
+inline uint16_t oqdepth(void)
 {
-	uint8_t* pnext = p + OQENTRYSZ;
-	if ( pnext == &oqueue[OQSZ] ) {
-		pnext = oqueue;
-	}
-	return pnext;
+	return OQ_FILL() / OQENTRYSZ;
 }
 
 inline uint8_t oqpush(uint8_t v1, uint8_t v2, uint8_t v3, uint8_t v4)
 {
-	uint8_t* p = oqnext(oqhead);
-	if ( p == oqtail ) {
+	if ( OQ_FILL() == OQ_ROOM * OQENTRYSZ ) {
+		STAT(++stats.oq_dropped);
 		return 0; // full
 	}
-	oqhead[0] = v1;
-	oqhead[1] = v2;
-	oqhead[2] = v3;
-	oqhead[3] = v4;
-	oqhead = p;
+	uint8_t* p = oqueue + OQ_AT(oqhead);
+	p[0] = v1;
+	p[1] = v2;
+	p[2] = v3;
+	p[3] = v4;
+	oqhead = OQ_NEXT(oqhead);
+#if STATS_INTERVAL
+	uint16_t depth = oqdepth();
+	if ( depth > stats.oq_max ) {
+		stats.oq_max = depth;
+	}
+#endif
 	return 1; // ok
 }
 
@@ -125,14 +670,607 @@ inline uint8_t oqpop(uint8_t* v1, uint8_t* v2, uint8_t* v3, uint8_t* v4)
 	if ( oqempty() ) {
 		return 0; // empty
 	}
-	*v1 = oqtail[0];
-	*v2 = oqtail[1];
-	*v3 = oqtail[2];
-	*v4 = oqtail[3];
-	oqtail = oqnext(oqtail);
+	uint8_t* p = oqueue + OQ_AT(oqtail);
+	*v1 = p[0];
+	*v2 = p[1];
+	*v3 = p[2];
+	*v4 = p[3];
+	oqtail = OQ_NEXT(oqtail);
 	return 1; // ok
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// pin change mask
+
+#if CAPTURE_PORT == 'B' || CAPTURE_PORT == 'X'
+
+// Port B pins that may be watched...
+#if CAPTURE_PORT == 'B'
+#define PCINT_WANTED ((EDGE_RISE_MASK | EDGE_FALL_MASK) & 0xFF)
+#elif RESET_OUTPUT_ENABLE
+#define PCINT_WANTED 0x7F
+#else
+#define PCINT_WANTED 0xFF
+#endif
+
+uint8_t pcint_mask = PCINT_WANTED; // being watched and reported
+
+#define PCINT_PINS(pv)	((pv) & pcint_mask)
+
+static uint8_t unhex(uint8_t c)
+{
+	if ( c >= '0' && c <= '9' ) {
+		return c - '0';
+	}
+	c |= 0x20;
+	if ( c >= 'a' && c <= 'f' ) {
+		return c - 'a' + 10;
+	}
+	return 0xFF;
+}
+
+// Handles the 'M' command: two hex digits of port B pins to watch. Returns
+// the main loop's previous pin state as seen through the new mask: pins
+// left out read as 0 from now on, and pins newly watched start from their
+// level now, so that neither looks like an edge at the next event.
+static pins_t pcint_command(uint8_t c1, uint8_t c2, pins_t prev_pv)
+{
+	uint8_t hi = unhex(c1);
+	uint8_t lo = unhex(c2);
+	if ( (hi | lo) & 0xF0 ) {
+		return prev_pv;
+	}
+	uint8_t added = ~pcint_mask;
+	pcint_mask = ((hi << 4) | lo) & PCINT_WANTED;
+	PCMSK0 = pcint_mask;
+	added &= pcint_mask;
+#if CAPTURE_PORT == 'X'
+	return (prev_pv & (((pins_t)pcint_mask << 4) | 0x0F)) | ((pins_t)(PINB & added) << 4);
+#else
+	return (prev_pv & pcint_mask) | (PINB & added);
+#endif
+}
+
+#else
+#define PCINT_PINS(pv)	(pv)
+#endif
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Timer1 epochs
+
+// The host counts Timer1 overflows to unwrap the 16-bit times, but timer
+// events are throttled, and an edge can read TCNT1 just after a wrap yet be
+// queued ahead of the overflow's own entry. So the main loop works out each
+// event's epoch exactly (from the timer events before it, plus TOV1 as the
+// ISR saw it, see note 3) and tells the host of any it hasn't heard of with
+// a "+DDDDDD" token, 6 hex digits of overflows to add, ahead of the event.
+// Within an epoch times only go up, so nothing is left for the host to guess.
+
+#define EPOCH_RECORD	0x40 // flag byte of an output queue entry of overflows
+#define EPOCH_MAX		0xFFFFFFUL // per record
+
+#if CAPTURE_PORT == 'X'
+#define IQ_TOV			0x80 // in the flag byte, see _DUAL_ISR
+#define TF_TIMER(tf)	(((tf) >> 4) == 1) // a flag digit the host counts
+#else
+#define IQ_TOV			0x01 // TIFR1 is the flag byte, see _CAPTURE_ISR
+#define TF_TIMER(tf)	((tf) == 1)
+#endif
+
+uint32_t iq_epoch; // Timer1 overflows before the input queue tail
+uint32_t epoch_sent; // as far as the host knows
+
+#if !IQ_COMPACT
+// Returns the epoch of an event from the input queue. An edge that found
+// TOV1 set read the timer either just before the wrap or after it, and the
+// top bit of the time tells which.
+static uint32_t epoch_of(uint8_t is_timer_event, uint8_t tov, uint8_t thi)
+{
+	if ( is_timer_event ) {
+		return ++iq_epoch;
+	}
+	return iq_epoch + (tov && thi < 0x80);
+}
+#endif
+
+// Queues records for the overflows up to epoch e that the host won't count
+// itself (it counts timer events), leaving room for the event's entries.
+// Returns 1 if the event is to be queued, 0 if there's no room or it's a
+// timer event the host doesn't need.
+static uint8_t epoch_push(uint32_t e, uint8_t is_timer_event, uint8_t entries)
+{
+	if ( is_timer_event && e == epoch_sent ) {
+		return 0; // an edge has already moved the host on
+	}
+	uint32_t d = e - epoch_sent - (is_timer_event ? 1 : 0);
+	while ( 1 ) {
+		if ( oqdepth() + entries + (d ? 1 : 0) > OQ_ROOM ) {
+			STAT(++stats.oq_dropped);
+			return 0; // no room
+		}
+		if ( !d ) {
+			break;
+		}
+		uint32_t n = (d < EPOCH_MAX) ? d : EPOCH_MAX;
+		oqpush(n, n >> 8, n >> 16, EPOCH_RECORD);
+		epoch_sent += n;
+		d -= n;
+	}
+	epoch_sent = e;
+	return 1;
+}
+
+static uint8_t epoch_format(char* p, uint8_t lo, uint8_t mid, uint8_t hi)
+{
+	*p++ = '+';
+	puthex(p, ((uint32_t)hi << 16) | ((uint16_t)mid << 8) | lo, 6);
+	return 7;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// compact input queue entries
+
+#if IQ_COMPACT
+
+uint16_t iq_time; // time of the entry at the input queue tail
+uint8_t iq_pins; // and its pins
+uint8_t iq_wrapped; // iq_time has wrapped since the last timer event
+
+// Rebuilds the entry at the input queue tail. Timer0 entries keep them
+// under 0x1000 ticks apart, so the 12 bits of time give the rest, and the
+// pins come out from under the top 4 (see COMPACT_ISR). An entry that
+// changes no pins is from Timer0 (or an edge undone before the ISR read the
+// port): the first since iq_time wrapped stays as the timer event, the rest
+// go. Returns 1 if the tail entry is ready to move on.
+static uint8_t iq_compact(uint8_t* iqueue, iqpos_t* tail, pins_t prev)
+{
+	if ( IQ_HEAD() == *tail ) {
+		return 0;
+	}
+	uint8_t* e = iqueue + *tail;
+	uint16_t t12 = ((uint16_t)(e[1] & 0xF0) << 4) | e[0];
+	uint16_t t = iq_time + ((t12 - iq_time) & 0x0FFF);
+	if ( t < iq_time ) {
+		iq_wrapped = 1;
+		++iq_epoch;
+	}
+	iq_time = t;
+	iq_pins = (e[1] ^ (t >> 12)) & 0x0F;
+	if ( iq_pins != prev || iq_wrapped ) {
+		return 1;
+	}
+	*tail = IQ_NEXT(*tail);
+	return 0;
+}
+
+#define IQ_READY(iqueue, tail, prev)	iq_compact((iqueue), &(tail), (prev))
+#endif
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// glitch filter
+
+#if GLITCH_TICKS
+
+#if CAPTURE_PORT == 'X'
+#define IQ_TIMER(e)	((e)[3] & 0x10)
+#define IQ_PINS(e)	(((pins_t)PCINT_PINS((e)[2]) << 4) | ((e)[3] & 0x0F))
+#else
+#define IQ_TIMER(e)	((e)[3] & 0x80)
+#define IQ_PINS(e)	PCINT_PINS((e)[2])
+#endif
+#define IQ_TIME(e)	((e)[0] | ((uint16_t)(e)[1] << 8))
+
+// Looks at the edge at the input queue tail and the event after it. If that
+// comes within GLITCH_TICKS and puts the pins back to prev, both go, otherwise
+// it takes the edge's time and the edge goes. Returns 1 if the tail entry is
+// ready to move on, 0 if the queue is empty or the edge is still held.
+static uint8_t glitch_filter(uint8_t* iqueue, iqpos_t* tail, pins_t prev)
+{
+	iqpos_t head = IQ_HEAD();
+	if ( head == *tail ) {
+		return 0;
+	}
+	uint8_t* a = iqueue + *tail;
+	if ( IQ_TIMER(a) ) {
+		return 1;
+	}
+	iqpos_t next = IQ_NEXT(*tail);
+	if ( head == next ) {
+		return 0; // hold it until the next event
+	}
+	uint8_t* b = iqueue + next;
+	if ( IQ_TIMER(b) || (uint16_t)(IQ_TIME(b) - IQ_TIME(a)) >= GLITCH_TICKS ) {
+		return 1;
+	}
+	if ( IQ_PINS(b) == prev ) {
+		*tail = IQ_NEXT(next);
+		STAT(stats.glitches += 2);
+	} else {
+		b[0] = a[0];
+		b[1] = a[1];
+		b[3] = (b[3] & ~IQ_TOV) | (a[3] & IQ_TOV); // and its epoch
+		*tail = next;
+		STAT(++stats.glitches);
+	}
+	return 0;
+}
+
+#define IQ_READY(iqueue, tail, prev)	glitch_filter((iqueue), &(tail), (prev))
+#elif !IQ_COMPACT
+#define IQ_READY(iqueue, tail, prev)	(IQ_HEAD() != (tail))
+#endif
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// edge selection
+
+#define EDGE_RECORD	0x30 // flag byte of an edge event whose next entry is a mask of missed edges
+
+#if EDGE_SELECT
+
+pins_t edge_sent; // pins of the last edge event queued
+pins_t edge_dropped; // changes dropped since then
+pins_t edge_missed; // for an EDGE_RECORD
+
+// Returns 0 if an edge event is to be dropped, otherwise sets *tf to 8 + n
+// if channel n had an edge since the last edge event queued that the host
+// can't place, or to EDGE_RECORD if several channels did. Timer events
+// aren't flagged: decoders only look at edge events, so the next one says
+// what was missed before it.
+static uint8_t edge_filter(pins_t pins, pins_t prev, uint8_t* tf)
+{
+	pins_t changed = pins ^ prev;
+	pins_t missed;
+#if CAPTURE_PORT == 'B'
+	// PCINT fires on any change, keep only the wanted ones...
+	if ( !((changed & pins & EDGE_RISE_MASK) | (changed & ~pins & EDGE_FALL_MASK)) ) {
+		edge_dropped |= changed;
+		return 0;
+	}
+	missed = edge_dropped;
+#else
+	// The INT pins only fire on wanted edges, so a single edge pin that has
+	// moved the other way since the last edge queued had an edge nobody saw.
+	// And if none of the pins captured on both edges changed, a single edge
+	// pin fired, so if it looks unchanged its other edge wasn't seen either...
+	pins_t unsent = pins ^ edge_sent;
+	pins_t at_edge = EDGE_SINGLE & ((pins & EDGE_RISE_MASK) | (~pins & EDGE_FALL_MASK));
+	missed = EDGE_SINGLE & ~at_edge & unsent;
+	if ( !(changed & ~EDGE_SINGLE) ) {
+		missed |= at_edge & ~unsent;
+	}
+#endif
+	if ( missed & (missed - 1) ) {
+		edge_missed = missed;
+		*tf = EDGE_RECORD;
+	} else if ( missed ) {
+		*tf = 8;
+		while ( !(missed & 1) ) {
+			++*tf;
+			missed >>= 1;
+		}
+	}
+	return 1;
+}
+
+// Notes an edge event as queued, adding the mask of an EDGE_RECORD.
+static void edge_sent_event(pins_t pins, uint8_t tf)
+{
+	if ( tf == EDGE_RECORD ) {
+		oqpush(edge_missed, 0, 0, 0);
+	}
+	edge_sent = pins;
+	edge_dropped = 0;
+}
+
+// Formats an EDGE_RECORD, taking the mask from the output queue.
+static uint8_t edge_format(char* p, uint8_t tlo, uint8_t thi, uint8_t pv)
+{
+	uint8_t missed, unused;
+	oqpop(&missed, &unused, &unused, &unused);
+	char* start = p;
+	p = puthex(p, ((uint16_t)thi << 8) | tlo, 4);
+	p = puthex(p, pv, 2);
+	*p++ = '8';
+	p = puthex(p, missed, 2);
+	return p - start;
+}
+
+#define EDGE_KEEP(pins, prev, tf)	edge_filter((pins), (prev), (tf))
+#define EDGE_SENT(pins, tf)			edge_sent_event((pins), (tf))
+#define EDGE_FORMAT(p, tlo, thi, pv)	edge_format((p), (tlo), (thi), (pv))
+#else
+#define EDGE_KEEP(pins, prev, tf)	1
+#define EDGE_SENT(pins, tf)
+#define EDGE_FORMAT(p, tlo, thi, pv)	0
+#endif
+
+// Output queue entries an edge event takes.
+#define EDGE_ENTRIES(tf)	(((tf) == EDGE_RECORD) ? 2 : 1)
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// PS/2 decoding
+
+#if PS2_DECODE_ENABLE
+
+#define PS2_CLK		((pins_t)1 << PS2_CLOCK_CH)
+#define PS2_DAT		((pins_t)1 << PS2_DATA_CH)
+#define PS2_TICKS_US	(F_CPU / 1000000)
+
+// As in host/ps2.c: device clock half periods are 30-50us and a host
+// inhibit is at least 100us, and a frame ends if the clock stops for 2ms...
+#define PS2_INHIBIT_TICKS	(75 * PS2_TICKS_US)
+#define PS2_TIMEOUT_TICKS	(2000UL * PS2_TICKS_US)
+
+// Record flags, PS2_ERR_* in host/ps2.h...
+#define PS2_ERR_START	0x01
+#define PS2_ERR_PARITY	0x02
+#define PS2_ERR_STOP	0x04
+#define PS2_ERR_ACK		0x08
+#define PS2_ERR_ABORT	0x10
+#define PS2_ERR_TIMEOUT	0x20
+#define PS2_HOST		0x40 // host to device
+#define PS2_RECORD		0x80 // in the flag byte of the first output queue entry
+
+typedef struct ps2_t {
+	uint32_t epoch; // of the event being decoded
+	uint32_t fall; // latest falling clock edge
+	uint32_t start; // of the frame
+	uint16_t min_period; // in ticks
+	uint16_t max_period;
+	uint16_t shift; // sampled bits, first in bit 0
+	uint8_t bits;
+	uint8_t dir; // 0 or PS2_HOST
+	uint8_t active; // in a frame
+	uint8_t rts; // host request to send seen, frame starts at next falling edge
+} ps2_t;
+
+ps2_t ps2;
+
+static void ps2_begin(uint32_t now, uint8_t dir)
+{
+	ps2.start = now;
+	ps2.dir = dir;
+	ps2.min_period = 0xFFFF;
+	ps2.max_period = 0;
+	ps2.shift = 0;
+	ps2.bits = 0;
+	ps2.active = 1;
+}
+
+static uint16_t ps2_us(uint32_t ticks, uint16_t max)
+{
+	ticks /= PS2_TICKS_US;
+	return ticks < max ? ticks : max;
+}
+
+// Queues the record for the frame, as two output queue entries: t, value,
+// PS2_RECORD | flags, then the periods in us, and the edges seen and span.
+static uint8_t ps2_end(uint16_t t, uint32_t now, uint8_t flags)
+{
+	ps2.active = 0;
+	uint8_t value = ps2.shift >> 1;
+	if ( ps2.bits == (ps2.dir ? 12 : 11) ) {
+		uint8_t odd = value ^ ((ps2.shift >> 9) & 1);
+		odd ^= odd >> 4;
+		odd ^= odd >> 2;
+		odd ^= odd >> 1;
+		if ( ps2.shift & 0x001 ) {
+			flags |= PS2_ERR_START;
+		}
+		if ( !(odd & 1) ) {
+			flags |= PS2_ERR_PARITY;
+		}
+		if ( !(ps2.shift & 0x400) ) {
+			flags |= PS2_ERR_STOP;
+		}
+		if ( ps2.dir && (ps2.shift & 0x800) ) {
+			flags |= PS2_ERR_ACK;
+		}
+	}
+	if ( !epoch_push(ps2.epoch, 0, 2) ) {
+		return 0; // no room for both entries
+	}
+	uint16_t span = ps2_us(now - ps2.start, 0xFFF);
+	oqpush(t, t >> 8, value, PS2_RECORD | ps2.dir | flags);
+	oqpush(ps2.max_period ? ps2_us(ps2.min_period, 0xFF) : 0, ps2_us(ps2.max_period, 0xFF),
+		span, (ps2.bits << 4) | (span >> 8));
+	return 1;
+}
+
+// Runs the decoder (host/ps2.c without the setup and hold times) over an
+// event, returns 1 if it queued a record.
+static uint8_t ps2_event(uint16_t t, uint32_t epoch, pins_t pins, pins_t prev, uint8_t is_timer_event)
+{
+	ps2.epoch = epoch;
+	uint32_t now = (epoch << 16) | t;
+
+	uint8_t queued = 0;
+	if ( ps2.active && now - ps2.fall > PS2_TIMEOUT_TICKS ) {
+		queued = ps2_end(t, now, PS2_ERR_TIMEOUT);
+	}
+	if ( is_timer_event || !((pins ^ prev) & PS2_CLK) ) {
+		return queued;
+	}
+	uint8_t data = (pins & PS2_DAT) ? 1 : 0;
+
+	if ( pins & PS2_CLK ) {
+		// rising: a long low period was the host inhibiting
+		if ( now - ps2.fall >= PS2_INHIBIT_TICKS ) {
+			if ( ps2.active ) {
+				queued = ps2_end(t, now, PS2_ERR_ABORT);
+			}
+			ps2.rts = !data;
+			if ( ps2.rts ) {
+				ps2_begin(now, PS2_HOST);
+				ps2.active = 0;
+			}
+		}
+		return queued;
+	}
+
+	// falling: sample data
+	uint16_t period = now - ps2.fall;
+	ps2.fall = now;
+	if ( ps2.rts ) {
+		ps2.rts = 0;
+		ps2.active = 1; // ps2_begin() was called at the request to send
+	} else if ( !ps2.active ) {
+		if ( data ) {
+			return queued; // not a start bit
+		}
+		ps2_begin(now, 0);
+	}
+	if ( ps2.bits ) {
+		if ( period < ps2.min_period ) {
+			ps2.min_period = period;
+		}
+		if ( period > ps2.max_period ) {
+			ps2.max_period = period;
+		}
+	}
+	ps2.shift |= (uint16_t)data << ps2.bits;
+	if ( ++ps2.bits == (ps2.dir ? 12 : 11) ) {
+		queued = ps2_end(t, now, 0);
+	}
+	return queued;
+}
+
+// Formats a record, taking its second entry from the output queue, returns
+// the length or 0 if the entry isn't a record.
+static uint8_t ps2_format(char* p, uint8_t tlo, uint8_t thi, uint8_t value, uint8_t flags)
+{
+	if ( !(flags & PS2_RECORD) ) {
+		return 0;
+	}
+	uint8_t min_us, max_us, span_lo, bits_span_hi;
+	oqpop(&min_us, &max_us, &span_lo, &bits_span_hi);
+	char* start = p;
+	*p++ = 'K';
+	p = puthex(p, ((uint16_t)thi << 8) | tlo, 4);
+	p = puthex(p, value, 2);
+	p = puthex(p, flags & ~PS2_RECORD, 2);
+	p = puthex(p, min_us, 2);
+	p = puthex(p, max_us, 2);
+	p = puthex(p, ((uint16_t)bits_span_hi << 8) | span_lo, 4);
+	return p - start;
+}
+
+#define PS2_EVENT(t, epoch, pins, prev, is_timer_event)	ps2_event((t), (epoch), (pins), (prev), (is_timer_event))
+#define PS2_FORMAT(p, tlo, thi, pv, tf)					ps2_format((p), (tlo), (thi), (pv), (tf))
+#else
+#define PS2_EVENT(t, epoch, pins, prev, is_timer_event)	0
+#define PS2_FORMAT(p, tlo, thi, pv, tf)					0
+#endif
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// predictive encoding
+
+#if PREDICT_ENABLE
+
+typedef struct predict_t {
+	uint16_t last[8]; // latest edge per channel
+	uint16_t interval[8]; // before it
+	uint16_t interval2[8]; // before that
+	uint8_t seen[8]; // edges since the start of the line, up to 3
+	uint16_t t; // previous event
+	uint8_t pins;
+	uint8_t synced; // an event has gone out since the start of the line
+	uint8_t run; // codes in the current token
+} predict_t;
+
+predict_t pred;
+
+static char predict_sym(uint8_t v)
+{
+	static const char PROGMEM syms[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz#$";
+	return pgm_read_byte(&syms[v & 0x3F]);
+}
+
+// Writes the event's code to p, starting a run if there isn't one, and
+// returns the length, or 0 if it needs a token. Either way the event then
+// goes into the prediction.
+static uint8_t predict_format(char* p, uint16_t t, uint8_t pins, uint8_t tf)
+{
+	if ( tf == EPOCH_RECORD ) {
+		return 0; // not an event
+	}
+	uint8_t changed = pins ^ pred.pins;
+	char* start = p;
+	if ( !tf && pred.synced && changed && !(changed & (changed - 1)) ) {
+		uint8_t c = 0;
+		while ( !(changed & (1 << c)) ) {
+			++c;
+		}
+		int16_t r = t - (pred.last[c] + pred.interval2[c]);
+		uint16_t d = t - pred.t;
+		if ( !pred.run ) {
+			*p++ = '~';
+		}
+		if ( pred.seen[c] >= 3 && r >= -2 && r < 2 ) {
+			*p++ = predict_sym((c << 2) | (r & 0x03));
+		} else if ( pred.seen[c] >= 3 && r >= -64 && r < 64 ) {
+			*p++ = predict_sym(0x20 | (c << 1) | ((r >> 6) & 0x01));
+			*p++ = predict_sym(r);
+		} else if ( d < 0x2000 ) {
+			*p++ = predict_sym(0x30 | (c << 1) | (d >> 12));
+			*p++ = predict_sym(d >> 6);
+			*p++ = predict_sym(d);
+		} else {
+			p = start;
+		}
+	}
+	for ( uint8_t c = 0; changed; ++c, changed >>= 1 ) {
+		if ( changed & 1 ) {
+			pred.interval2[c] = pred.interval[c];
+			pred.interval[c] = t - pred.last[c];
+			pred.last[c] = t;
+			if ( pred.seen[c] < 3 ) {
+				++pred.seen[c];
+			}
+		}
+	}
+	pred.t = t;
+	pred.pins = pins;
+	pred.synced = 1;
+	if ( p != start ) {
+		++pred.run;
+	}
+	return p - start;
+}
+
+static void predict_reset(void)
+{
+	bytes_clear(pred.seen, sizeof(pred.seen));
+	pred.synced = 0;
+	pred.run = 0;
+}
+
+#define PREDICT_FORMAT(p, t, pv, tf)	predict_format((p), (t), (pv), (tf))
+#define PREDICT_RUN()					pred.run
+#define PREDICT_RUN_FULL()				(pred.run == PREDICT_RUN_MAX)
+#define PREDICT_RUN_END()				(pred.run = 0)
+#define PREDICT_RESET()					predict_reset()
+#else
+#define PREDICT_FORMAT(p, t, pv, tf)	0
+#define PREDICT_RUN()					0
+#define PREDICT_RUN_FULL()				1
+#define PREDICT_RUN_END()
+#define PREDICT_RESET()
+#endif
+
+// Ends an item of output (a token, or a run of codes) with a space, or a
+// newline every items_per_line.
+static char item_end(uint8_t* remaining, uint8_t items_per_line)
+{
+	PREDICT_RUN_END();
+	if ( --*remaining ) {
+		return ' ';
+	}
+	*remaining = items_per_line;
+	PREDICT_RESET();
+	return '\n';
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 // main
 
@@ -155,146 +1293,385 @@ int main(void)
 #endif
 
 	// Init buffer for events from the ISRs...
-	// Makefile has this line to move the start of data forward by the 256 needed for the queue:
-	// LDFLAGS += -Wl,--section-start,.data=0x800200
+	// Makefile moves the start of data forward by the IQSZ needed for the queue:
+	// LDFLAGS += -Wl,--section-start,.data=0x800200 (for 1 page)
 	// The queue is locked to 0x0100 so that wrapping the qhead and qtail variables is trivial.
 	uint8_t* iqueue = (uint8_t*)(IQPAGE << 8);
 	iqpage = IQPAGE;
 	iqhead = 0;
-	uint8_t iqtail = 0;
+	iqpos_t iqtail = 0;
 
 	// Set register used to clear pending interrupts in ISR...
 	eifrclr = INTERRUPT_FLAG_CLEAR;
 
 	// Setup inputs and interrupts...
-#if CAPTURE_PORT == 'D'
+#if CAPTURE_PORT == 'D' || CAPTURE_PORT == 'X'
 	// .. for INT0 to INT3 pins...
 	DDRD = 0; // may as well input the entire port
 	PORTD = 0xFF; // set pull-ups on
-	EICRA = 0x55; // trigger on either edge
+	EICRA = EDGE_EICRA; // trigger on the selected edges
 	EIFR = eifrclr; // clear pending
-	EIMSK |= 0x0F; // enable
-#else // 'B'
+	EIMSK |= (EDGE_RISE_MASK | EDGE_FALL_MASK) & 0x0F; // enable
+#endif
+#if CAPTURE_PORT == 'B' || CAPTURE_PORT == 'X'
 	// .. for PCINT pins...
 	DDRB = 0; // input the entire port
 	PORTB = 0xFF; // set pull-ups on
 	PCICR = 0x01; // enable
-	PCIFR = eifrclr; // clear pending
-	PCMSK0 |= 0xFF; // enable all
+	PCIFR = 0x01; // clear pending
+	PCMSK0 = pcint_mask; // enable all wanted, but not the reset output
 #endif
 
-	uint8_t prev_pv = CAPTURE_PORT_IN;
+#if CAPTURE_PORT == 'X'
+	pins_t prev_pv = ((pins_t)PCINT_PINS(PINB) << 4) | (PIND & 0x0F);
+#elif IQ_COMPACT
+	pins_t prev_pv = CAPTURE_PORT_IN & 0x0F;
+#else
+	pins_t prev_pv = PCINT_PINS(CAPTURE_PORT_IN);
+#endif
 
 	// Setup Timer 1 for the capture event timebase...
 	TCCR1A = 0x00; // set timer 1 to normal mode
+#if IQ_COMPACT
+	// ... with Timer0 overflowing every 2048 ticks instead of Timer1's interrupt
+	TCCR0A = 0x00;
+	TCCR0B = 0x02; // clock speed / 8, as for profiling on the 32U2
+	TIMSK0 |= (1 << TOIE0);
+	TCNT1 = 0; // where the main loop's rebuilt time starts
+	TCCR1B = 0x01; // start timer running at clock speed
+#else
 	TCCR1B = 0x01; // start timer running at clock speed
 	//TCCR1B = 0x02; // start timer running at clock speed / 8
 	TIMSK1 |= (1 << TOIE1); // enable overflow interrupt
+#endif
 
 	// Buffer for formatted text ready for output...
-	static char obuf[16];
+	static char obuf[20];
 	uint8_t obuf_idx = 0;
 	obuf[obuf_idx] = 0;
 
-	print("sctrace v1.01\n");
+	print("sctrace v1.02\n");
 	const uint8_t max_timer_events = 2;
 	uint8_t allow_timer_events = max_timer_events;
+	const uint8_t items_per_line = 10;
+	uint8_t remaining = items_per_line;
+#if REPORTS_ENABLE
+	uint8_t report = 0; // REPORT_ line being output, 0 if none
+	uint8_t report_field = 0; // its next field
+#endif
+#if STATS_INTERVAL
+	uint16_t stats_ticks = 0;
+	uint8_t stats_wanted = 0;
+#endif
+#if PROFILE_ENABLE
+	uint8_t profile_wanted = 0;
+	PROFILE_TIMER_INIT();
+#endif
 	while ( 1 ) {
+		// Handle a command from the host...
+		if ( usb_debug_cmd_len ) {
+			switch ( usb_debug_cmd[0] ) {
+#if STATS_INTERVAL
+			case 'S':
+				stats_wanted = 1;
+				break;
+#endif
+#if PROFILE_ENABLE
+			case 'P':
+				profile_wanted = 1;
+				break;
+#endif
+#if STACK_PAINT_ENABLE
+			case 'W':
+				mem_scan = &_end;
+				break;
+#endif
+#if CAPTURE_PORT == 'B' || CAPTURE_PORT == 'X'
+			case 'M':
+				prev_pv = pcint_command(usb_debug_cmd[1], usb_debug_cmd[2], prev_pv);
+				break;
+#endif
+			}
+			usb_debug_cmd_len = 0;
+		}
+
+		STAT(++stats.loops);
+		PROF_START();
+
 		// Move from the input queue to the larger output queue, skipping excess timer events...
-		if ( iqhead != iqtail ) { // if input queue isn't empty
+		if ( IQ_READY(iqueue, iqtail, prev_pv) ) { // if input queue has an event ready
+#if IQ_COMPACT
+			uint8_t tlo = iq_time;
+			uint8_t thi = iq_time >> 8;
+			uint8_t pv = iq_pins;
+			uint8_t is_timer_event = (pv == prev_pv); // see iq_compact()
+			if ( is_timer_event ) {
+				iq_wrapped = 0;
+			}
+			uint8_t tf = is_timer_event;
+			pins_t pins = pv;
+			uint32_t epoch = iq_epoch;
+#else
 			uint8_t tlo = iqueue[iqtail];
 			uint8_t thi = iqueue[iqtail+1];
-			uint8_t pv = iqueue[iqtail+2];
-			uint8_t is_timer_event = !iqueue[iqtail+3];
-			iqtail += IQENTRYSZ;
+			uint8_t pv = PCINT_PINS(iqueue[iqtail+2]); // pins left out read as 0
+#if CAPTURE_PORT == 'X'
+			uint8_t tf = iqueue[iqtail+3] & ~IQ_TOV; // flag digit << 4 | port D pins, see _DUAL_ISR
+			uint8_t is_timer_event = tf & 0x10;
+			pins_t pins = ((pins_t)pv << 4) | (tf & 0x0F);
+#else
+			uint8_t is_timer_event = iqueue[iqtail+3] >> 7; // see _CAPTURE_ISR
+			uint8_t tf = is_timer_event;
+			pins_t pins = pv;
+#endif
+			uint32_t epoch = epoch_of(is_timer_event, iqueue[iqtail+3] & IQ_TOV, thi);
+#endif
+			iqtail = IQ_NEXT(iqtail);
 			//uint8_t is_timer_event = (pv == prev_pv) && (thi == 0);
-			prev_pv = pv;
+#if STATS_INTERVAL
+			uint16_t depth = ((iqpos_t)(IQ_HEAD() - iqtail) & (IQSZ - 1)) / IQENTRYSZ + 1;
+			if ( depth > stats.iq_max ) {
+				stats.iq_max = depth;
+			}
+			pins_t changed = pins ^ prev_pv;
+			for ( uint8_t n = 0; changed && n < CAPTURE_PINS; ++n, changed >>= 1 ) {
+				if ( changed & 1 ) {
+					++stats.edges[n];
+				}
+			}
+			if ( is_timer_event && ++stats_ticks >= STATS_INTERVAL ) {
+				stats_wanted = 1;
+			}
+#endif
+			if ( PS2_EVENT(((uint16_t)thi << 8) | tlo, epoch, pins, prev_pv, is_timer_event) ) {
+				allow_timer_events = max_timer_events; // a byte went out
+			}
 			if ( is_timer_event ) {
 				if ( allow_timer_events ) {
-					oqpush(tlo, thi, pv, is_timer_event);
+					if ( epoch_push(epoch, TF_TIMER(tf), 1) ) {
+						oqpush(tlo, thi, pv, tf);
+					}
 					--allow_timer_events;
+				} else {
+					STAT(++stats.timer_skipped);
 				}
-			} else {
-				oqpush(tlo, thi, pv, is_timer_event);
+			} else if ( !PS2_DECODE_ENABLE && EDGE_KEEP(pins, prev_pv, &tf) && epoch_push(epoch, 0, EDGE_ENTRIES(tf)) ) {
+				oqpush(tlo, thi, pv, tf);
+				EDGE_SENT(pins, tf);
 				allow_timer_events = max_timer_events;
 			}
+			prev_pv = pins;
+		}
+
+		PROF_STAGE(PROF_IQ);
+
+#if REPORTS_ENABLE
+		// Start a report line, counting afresh while it's output...
+		if ( !report ) {
+#if STATS_INTERVAL
+			if ( stats_wanted ) {
+				bytes_copy(&stats_out, &stats, sizeof(stats));
+				stats_out.usb_timeouts = usb_debug_timeouts;
+				usb_debug_timeouts = 0;
+				bytes_clear(&stats, sizeof(stats));
+				stats_ticks = 0;
+				stats_wanted = 0;
+				report = REPORT_STATS;
+			}
+#endif
+#if PROFILE_ENABLE
+			if ( !report && profile_wanted ) {
+				bytes_copy(&prof_out, &prof, sizeof(prof));
+				bytes_clear(&prof, sizeof(prof));
+				profile_wanted = 0;
+				report = REPORT_PROFILE;
+			}
+#endif
+#if STACK_PAINT_ENABLE
+			if ( !report && mem_scan && mem_scan_step() ) {
+				report = REPORT_MEM;
+			}
+#endif
+			report_field = 1;
 		}
 
+		// ... and output it a field at a time, at the next token boundary...
+		if ( !obuf[obuf_idx] && report ) {
+			char* p = obuf;
+			if ( report_field == 1 && (PREDICT_RUN() || remaining != items_per_line) ) {
+				*p++ = '\n';
+			}
+			report_field = report_format(p, report, report_field);
+			if ( !report_field ) {
+				report = 0;
+				remaining = items_per_line;
+				PREDICT_RESET();
+			}
+			obuf_idx = 0;
+		}
+#endif
+
 		// Move from the output queue to the formatted output buffer...
 		if ( !obuf[obuf_idx] && !oqempty() ) {
 			uint8_t tlo, thi, pv, tf;
 			oqpop(&tlo, &thi, &pv, &tf);
-			uint8_t i = 0;
-			obuf[i++] = hex(thi >> 4);
-			obuf[i++] = hex(thi & 0x0F);
-			obuf[i++] = hex(tlo >> 4);
-			obuf[i++] = hex(tlo & 0x0F);
-			obuf[i++] = hex(pv >> 4);
-			obuf[i++] = hex(pv & 0x0F);
-			obuf[i++] = hex(tf & 0x01);
-			const uint8_t items_per_line = 10;
-			static uint8_t remaining = items_per_line;
-			if ( --remaining ) {
-				obuf[i++] = ' ';
+			uint8_t i = PREDICT_FORMAT(obuf, ((uint16_t)thi << 8) | tlo, pv, tf); // a code in a run, if predictable
+			if ( i ) {
+				// ... and the run ends when full or there's nothing more to send for now
+				if ( PREDICT_RUN_FULL() || oqempty() ) {
+					obuf[i++] = item_end(&remaining, items_per_line);
+				}
 			} else {
-				obuf[i++] = '\n';
-				remaining = items_per_line;
+				if ( PREDICT_RUN() ) {
+					obuf[i++] = item_end(&remaining, items_per_line);
+				}
+				uint8_t n;
+				if ( tf == EPOCH_RECORD ) {
+					n = epoch_format(obuf + i, tlo, thi, pv);
+				} else if ( tf == EDGE_RECORD ) {
+					n = EDGE_FORMAT(obuf + i, tlo, thi, pv);
+				} else {
+					n = PS2_FORMAT(obuf + i, tlo, thi, pv, tf); // 0 unless a PS/2 record
+				}
+				if ( n ) {
+					i += n;
+				} else {
+					obuf[i++] = hex(thi >> 4);
+					obuf[i++] = hex(thi & 0x0F);
+					obuf[i++] = hex(tlo >> 4);
+					obuf[i++] = hex(tlo & 0x0F);
+					obuf[i++] = hex(pv >> 4);
+					obuf[i++] = hex(pv & 0x0F);
+#if CAPTURE_PORT == 'X'
+					obuf[i++] = hex(tf & 0x0F);
+					obuf[i++] = hex(tf >> 4);
+#else
+					obuf[i++] = hex(tf & 0x0F);
+#endif
+				}
+				obuf[i++] = item_end(&remaining, items_per_line);
 			}
 			obuf[i++] = 0;
 			obuf_idx = 0;
 		}
+		PROF_STAGE(PROF_FMT);
 
 		// Send from the formatted output buffer...
 		if ( obuf[obuf_idx] && usb_debug_ready() ) {
 			usb_debug_putchar(obuf[obuf_idx++]);
 		}
+		PROF_STAGE(PROF_USB);
 
 		// Allow flushing of debug output without using an ISR, since that
 		// could block our capture ISRs...
 		usb_debug_task();
+		PROF_STAGE(PROF_TASK);
 	}
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 // ISRs
 
-#define _CAPTURE_ISR(capflag) asm volatile \
+// End of every ISR: wrap X back to the start of the input queue.
+#if IQPAGES == 1
+#define IQ_WRAP \
+	"ldi r27, %[iqpage]"	"\n\t"	/* reset high byte of X */ \
+	"reti"					"\n\t"
+#else
+// r27 is only past the last page at IQPAGE + IQPAGES, 3 or 5, the first
+// page with both bit 0 and iqwrapbit set. Unlike a compare, the skips
+// leave SREG alone.
+#define IQ_WRAP \
+	"sbrc r27, %[iqwrapbit]"	"\n\t"	/* still in the queue unless both bits are set */ \
+	"sbrs r27, 0"			"\n\t" \
+	"reti"					"\n\t" \
+	"ldi r27, %[iqpage]"	"\n\t"	/* reset high byte of X */ \
+	"reti"					"\n\t"
+#endif
+
+#define _CAPTURE_ISR(flag) asm volatile \
 ( \
 	"out %[eifr], r6"		"\n\t"	/* clear pending external interrupts (note 1) */ \
 	"in r3, %[pin]"			"\n\t"	/* read port (note 2) */ \
 	"lds r4, %[tcnt1l]"		"\n\t"	/* read timer lo */ \
 	"lds r5, %[tcnt1h]"		"\n\t"	/* read timer hi */ \
+	flag					"\n\t"	/* flag byte (note 3) */ \
 	"st X+, r4"				"\n\t"	/* store timer lo */ \
 	"st X+, r5"				"\n\t"	/* store timer hi */ \
 	"st X+, r3"				"\n\t"	/* store port state */ \
-	"st X+, " #capflag		"\n\t"	/* store non-zero byte to indicate capture */ \
-	"ldi r27, %[iqpage]"	"\n\t"	/* reset high byte of X */ \
-	"reti"					"\n\t" \
+	"st X+, r17"			"\n\t"	/* store flag byte */ \
+	IQ_WRAP \
 	: \
 	: [tcnt1l] "X" (TCNT1L), [tcnt1h] "X" (TCNT1H), [iqpage] "X" (IQPAGE), \
+	  [iqwrapbit] "I" ((IQPAGES == 2) ? 1 : 2), [tifr1] "I" (_SFR_IO_ADDR(TIFR1)), \
 	  [pin] "I" (_SFR_IO_ADDR(CAPTURE_PORT_IN)), [eifr] "I" (_SFR_IO_ADDR(INTERRUPT_FLAG_REG)) \
 )
 
-#define TIMER_ISR() _CAPTURE_ISR(__zero_reg__)
-#define CAPTURE_ISR() _CAPTURE_ISR(r6)
+// The flag byte of an edge is TIFR1, whose top bit is always 0.
+#define TIMER_ISR() _CAPTURE_ISR("ldi r17, 0x80")
+#define CAPTURE_ISR() _CAPTURE_ISR("in r17, %[tifr1]")
 
-#define OLD_CAPTURE_ISR() asm volatile \
+// Compact entries (IQ_COMPACT): timer lo, then timer bits 8..11 over bits
+// 12..15 xor the INT pins, which the main loop undoes once it knows the
+// time. That needs and/eor, and no instruction that leaves SREG alone can
+// merge the nibbles, so SREG is saved in r16 around them. Without the flag
+// byte and two of the stores it still takes 15 cycles up to IQ_WRAP, as
+// _CAPTURE_ISR does; what compact entries cost is Timer0's interrupts (see
+// IQ_COMPACT). r6 doubles as the 0x0F mask.
+#define COMPACT_ISR() asm volatile \
 ( \
 	"out %[eifr], r6"		"\n\t"	/* clear pending external interrupts (note 1) */ \
 	"in r3, %[pin]"			"\n\t"	/* read port (note 2) */ \
 	"lds r4, %[tcnt1l]"		"\n\t"	/* read timer lo */ \
 	"lds r5, %[tcnt1h]"		"\n\t"	/* read timer hi */ \
+	"in r16, __SREG__"		"\n\t"	/* save flags */ \
+	"and r3, r6"			"\n\t"	/* keep INT0..INT3 pins */ \
+	"swap r5"				"\n\t"	/* timer bits 8..11 to the high nibble */ \
+	"eor r5, r3"			"\n\t"	/* pins into the low one */ \
+	"out __SREG__, r16"		"\n\t"	/* restore flags */ \
+	"st X+, r4"				"\n\t"	/* store timer lo */ \
+	"st X+, r5"				"\n\t"	/* store timer hi and port state */ \
+	IQ_WRAP \
+	: \
+	: [tcnt1l] "X" (TCNT1L), [tcnt1h] "X" (TCNT1H), [iqpage] "X" (IQPAGE), \
+	  [iqwrapbit] "I" ((IQPAGES == 2) ? 1 : 2), \
+	  [pin] "I" (_SFR_IO_ADDR(CAPTURE_PORT_IN)), [eifr] "I" (_SFR_IO_ADDR(INTERRUPT_FLAG_REG)) \
+)
+
+// Dual port capture: both ports are read, port D's INT pins go in the low
+// nibble of the flag byte and the source in the high nibble, as the flag
+// digit the host sees (0 = INTn, 1 = Timer1, 2 = PCINT0). That needs andi/ori,
+// so SREG is saved in r16 around them. Unlike TIMER_ISR, the timer doesn't
+// clear pending edges here, so that each one is reported with its source.
+#define _DUAL_ISR(clear, tag) asm volatile \
+( \
+	clear									/* clear pending interrupts (note 1) */ \
+	"in r3, %[pinb]"		"\n\t"	/* read ports (note 2) */ \
+	"in r17, %[pind]"		"\n\t" \
+	"lds r4, %[tcnt1l]"		"\n\t"	/* read timer lo */ \
+	"lds r5, %[tcnt1h]"		"\n\t"	/* read timer hi */ \
+	"in r16, __SREG__"		"\n\t"	/* save flags */ \
+	"andi r17, 0x0F"		"\n\t"	/* keep INT0..INT3 pins */ \
+	"ori r17, " #tag		"\n\t"	/* add source */ \
+	"sbic %[tifr1], 0"		"\n\t"	/* add 0x80 if TOV1 is set (note 3) */ \
+	"ori r17, 0x80"			"\n\t" \
+	"out __SREG__, r16"		"\n\t"	/* restore flags */ \
 	"st X+, r4"				"\n\t"	/* store timer lo */ \
 	"st X+, r5"				"\n\t"	/* store timer hi */ \
-	"st X+, r3"				"\n\t"	/* store port state */ \
-	"in r2, __SREG__"		"\n\t"	/* save flags */ \
-	"inc r26"				"\n\t"	/* increment qhead with 8-bit wrap-around */ \
-	"out __SREG__, r2"		"\n\t"	/* restore flags */ \
-	"reti"					"\n\t" \
+	"st X+, r3"				"\n\t"	/* store port B state */ \
+	"st X+, r17"			"\n\t"	/* store source and port D state */ \
+	IQ_WRAP \
 	: \
-	: [tcnt1l] "X" (TCNT1L), [tcnt1h] "X" (TCNT1H), [pin] "I" (_SFR_IO_ADDR(CAPTURE_PORT_IN)), [eifr] "I" (_SFR_IO_ADDR(INTERRUPT_FLAG_REG)) \
+	: [tcnt1l] "X" (TCNT1L), [tcnt1h] "X" (TCNT1H), [iqpage] "X" (IQPAGE), \
+	  [iqwrapbit] "I" ((IQPAGES == 2) ? 1 : 2), \
+	  [pinb] "I" (_SFR_IO_ADDR(PINB)), [pind] "I" (_SFR_IO_ADDR(PIND)), [tifr1] "I" (_SFR_IO_ADDR(TIFR1)), \
+	  [eifr] "I" (_SFR_IO_ADDR(EIFR)), [pcifr] "I" (_SFR_IO_ADDR(PCIFR)) \
 )
 
+#define DUAL_TIMER_ISR() _DUAL_ISR("", 0x10)
+#define DUAL_INT_ISR() _DUAL_ISR("out %[eifr], r6\n\t", 0x00)
+#define DUAL_PCINT_ISR() _DUAL_ISR("ldi r16, 0x01\n\tout %[pcifr], r16\n\t", 0x20)
+
 // Notes:
 //
 // 1. Pending external interrupts are cleared to avoid having to process
@@ -304,6 +1681,33 @@ int main(void)
 //
 // 2. The port is read before the timer because offsetting the timer by any
 //	constant time is irrelevant.
+//
+// 3. TOV1 is read after the timer, so if it was set when the timer was read
+//	it still is (edges outrank the Timer1 overflow, whose vector clears it).
+//	Set, it puts the event in the epoch after the last timer event queued,
+//	unless the timer was read just before the wrap (see epoch_of()).
+
+#if CAPTURE_PORT == 'X'
+
+ISR(TIMER1_OVF_vect, ISR_NAKED) { DUAL_TIMER_ISR(); }
+
+ISR(INT0_vect, ISR_NAKED) { DUAL_INT_ISR(); }
+ISR(INT1_vect, ISR_NAKED) { DUAL_INT_ISR(); }
+ISR(INT2_vect, ISR_NAKED) { DUAL_INT_ISR(); }
+ISR(INT3_vect, ISR_NAKED) { DUAL_INT_ISR(); }
+
+ISR(PCINT0_vect, ISR_NAKED) { DUAL_PCINT_ISR(); }
+
+#elif IQ_COMPACT
+
+ISR(TIMER0_OVF_vect, ISR_NAKED) { COMPACT_ISR(); }
+
+ISR(INT0_vect, ISR_NAKED) { COMPACT_ISR(); }
+ISR(INT1_vect, ISR_NAKED) { COMPACT_ISR(); }
+ISR(INT2_vect, ISR_NAKED) { COMPACT_ISR(); }
+ISR(INT3_vect, ISR_NAKED) { COMPACT_ISR(); }
+
+#else
 
 ISR(TIMER1_OVF_vect, ISR_NAKED) { TIMER_ISR(); }
 
@@ -313,3 +1717,5 @@ ISR(INT2_vect, ISR_NAKED) { CAPTURE_ISR(); }
 ISR(INT3_vect, ISR_NAKED) { CAPTURE_ISR(); }
 
 ISR(PCINT0_vect, ISR_NAKED) { CAPTURE_ISR(); }
+
+#endif
@@ -143,6 +143,7 @@
 
 #define ENDPOINT0_SIZE		32
 #define DEBUG_TX_SIZE		32
+// DEBUG_RX_SIZE (usb_debug_only.h) is received through SET_REPORT on endpoint 0
 #define DEBUG_TX_BUFFER		EP_DOUBLE_BUFFER
 
 static const uint8_t PROGMEM endpoint_config_table[] = {
@@ -193,6 +194,9 @@ static const uint8_t PROGMEM hid_report_descriptor[] = {
 	0x95, DEBUG_TX_SIZE,			// report count
 	0x09, 0x75,				// usage
 	0x81, 0x02,				// Input (array)
+	0x95, DEBUG_RX_SIZE,			// report count
+	0x09, 0x76,				// usage
+	0x91, 0x02,				// Output (array)
 	0xC0					// end collection
 };
 
@@ -293,6 +297,16 @@ static volatile uint8_t usb_configuration=0;
 // packet, or send a zero length packet.
 static volatile uint8_t debug_flush_timer=0;
 
+// number of times usb_debug_putchar() gave up waiting for the host
+uint16_t usb_debug_timeouts=0;
+
+// last command received from the host, length is zero once it's been handled
+volatile uint8_t usb_debug_cmd[DEBUG_RX_SIZE];
+volatile uint8_t usb_debug_cmd_len=0;
+
+// a SET_REPORT is waiting for usb_debug_task() to read its data stage
+static volatile uint8_t debug_cmd_pending=0;
+
 
 /**************************************************************************
  *
@@ -355,6 +369,7 @@ int8_t usb_debug_putchar(uint8_t c)
 		// have we waited too long?
 		if (UDFNUML == timeout) {
 			previous_timeout = 1;
+			++usb_debug_timeouts;
 			return -1;
 		}
 		// has the USB gone offline?
@@ -397,6 +412,30 @@ void usb_debug_flush_output(void)
 
 void usb_debug_task(void)
 {
+	// Read a command's data stage here rather than in USB_COM_vect, which
+	// would hold up the capture interrupts until the host sent it...
+	if ( debug_cmd_pending ) {
+		uint8_t intr_state = SREG;
+		cli();
+		UENUM = 0;
+		if ( UEINTX & (1<<RXOUTI) ) {
+			// a command that hasn't been handled yet wins
+			uint8_t n = UEBCLX;
+			if ( !usb_debug_cmd_len && n ) {
+				if ( n > DEBUG_RX_SIZE ) n = DEBUG_RX_SIZE;
+				for ( uint8_t i = 0; i < n; i++ ) {
+					usb_debug_cmd[i] = UEDATX;
+				}
+				usb_debug_cmd_len = n;
+			}
+			UEINTX = ~(1<<RXOUTI);	// ack the data
+			UEINTX = ~(1<<TXINI);	// and send the status stage
+			debug_cmd_pending = 0;
+		}
+		UENUM = DEBUG_TX_ENDPOINT;
+		SREG = intr_state;
+	}
+
 	uint8_t intbits = UDINT;
 	if ( intbits & (1<<SOFI) ) {
 		UDINT = UDINT & ~(1<<SOFI);
@@ -505,6 +544,7 @@ ISR(USB_COM_vect)
 	UENUM = 0;
 	intbits = UEINTX;
 	if (intbits & (1<<RXSTPI)) {
+		debug_cmd_pending = 0;	// a new request replaces a SET_REPORT left waiting
 		bmRequestType = UEDATX;
 		bRequest = UEDATX;
 		wValue = UEDATX;
@@ -649,6 +689,14 @@ ISR(USB_COM_vect)
 				return;
 			}
 		}
+		if (bRequest == HID_SET_REPORT && bmRequestType == 0x21) {
+			if (wIndex == 0) {
+				// the data stage follows; usb_debug_task() reads it
+				debug_cmd_pending = 1;
+				UENUM = DEBUG_TX_ENDPOINT;
+				return;
+			}
+		}
 	}
 	UECONX = (1<<STALLRQ) | (1<<EPEN);	// stall
 	UENUM = DEBUG_TX_ENDPOINT;
@@ -10,6 +10,14 @@ uint8_t usb_configured(void);		// is the USB port configured
 
 int8_t usb_debug_putchar(uint8_t c);	// transmit a character
 void usb_debug_flush_output(void);	// immediately transmit any buffered output
+extern uint16_t usb_debug_timeouts;	// putchar timeouts waiting for the host
+
+// Commands from the host arrive as output reports of DEBUG_RX_SIZE bytes,
+// read by usb_debug_task(). usb_debug_cmd_len is nonzero while one is
+// waiting; clear it when done.
+#define DEBUG_RX_SIZE		8
+extern volatile uint8_t usb_debug_cmd[DEBUG_RX_SIZE];
+extern volatile uint8_t usb_debug_cmd_len;
 #define USB_DEBUG_HID
 
 #define DEBUG_TX_ENDPOINT	3